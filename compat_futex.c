@@ -27,6 +27,8 @@
 #include <errno.h>
 #include <poll.h>
 #include <stdint.h>
+#include <time.h>
+#include <sys/time.h>
 
 #include <urcu/arch.h>
 #include <urcu/futex.h>
@@ -34,25 +36,57 @@
 static pthread_mutex_t compat_futex_lock = PTHREAD_MUTEX_INITIALIZER;
 static pthread_cond_t compat_futex_cond = PTHREAD_COND_INITIALIZER;
 
+/*
+ * Convert a relative futex timeout into an absolute time, suitable for
+ * pthread_cond_timedwait().
+ */
+static void compat_futex_abstime(const struct timespec *timeout,
+		struct timespec *abstime)
+{
+	struct timeval now;
+
+	gettimeofday(&now, NULL);
+	abstime->tv_sec = now.tv_sec + timeout->tv_sec;
+	abstime->tv_nsec = now.tv_usec * 1000 + timeout->tv_nsec;
+	if (abstime->tv_nsec >= 1000000000) {
+		abstime->tv_sec++;
+		abstime->tv_nsec -= 1000000000;
+	}
+}
+
+/* Milliseconds elapsed since "start", rounded up. */
+static long compat_futex_elapsed_ms(const struct timeval *start)
+{
+	struct timeval now;
+
+	gettimeofday(&now, NULL);
+	return (now.tv_sec - start->tv_sec) * 1000
+		+ (now.tv_usec - start->tv_usec + 999) / 1000;
+}
+
 /*
  * _NOT SIGNAL-SAFE_. pthread_cond is not signal-safe anyway. Though.
- * For now, timeout, uaddr2 and val3 are unused.
- * Waiter will relinquish the CPU until woken up.
+ * For now, uaddr2 and val3 are unused.
+ * Waiter will relinquish the CPU until woken up, or until the relative
+ * timeout expires, in which case -ETIMEDOUT is returned.
  */
 
 int compat_futex_noasync(int32_t *uaddr, int op, int32_t val,
 	const struct timespec *timeout, int32_t *uaddr2, int32_t val3)
 {
 	int ret, gret = 0;
+	struct timespec abstime;
 
 	/*
 	 * Check if NULL. Don't let users expect that they are taken into
 	 * account. 
 	 */
-	assert(!timeout);
 	assert(!uaddr2);
 	assert(!val3);
 
+	if (timeout)
+		compat_futex_abstime(timeout, &abstime);
+
 	/*
 	 * memory barriers to serialize with the previous uaddr modification.
 	 */
@@ -64,7 +98,15 @@ int compat_futex_noasync(int32_t *uaddr, int op, int32_t val,
 	case FUTEX_WAIT:
 		if (*uaddr != val)
 			goto end;
-		pthread_cond_wait(&compat_futex_cond, &compat_futex_lock);
+		if (timeout) {
+			ret = pthread_cond_timedwait(&compat_futex_cond,
+					&compat_futex_lock, &abstime);
+			if (ret == ETIMEDOUT)
+				gret = -ETIMEDOUT;
+		} else {
+			pthread_cond_wait(&compat_futex_cond,
+					&compat_futex_lock);
+		}
 		break;
 	case FUTEX_WAKE:
 		pthread_cond_broadcast(&compat_futex_cond);
@@ -80,21 +122,30 @@ end:
 
 /*
  * _ASYNC SIGNAL-SAFE_.
- * For now, timeout, uaddr2 and val3 are unused.
- * Waiter will busy-loop trying to read the condition.
+ * For now, uaddr2 and val3 are unused.
+ * Waiter will busy-loop trying to read the condition, until the
+ * relative timeout expires, in which case -ETIMEDOUT is returned.
  */
 
 int compat_futex_async(int32_t *uaddr, int op, int32_t val,
 	const struct timespec *timeout, int32_t *uaddr2, int32_t val3)
 {
+	struct timeval start;
+	long timeout_ms = 0, remain_ms;
+
 	/*
 	 * Check if NULL. Don't let users expect that they are taken into
 	 * account. 
 	 */
-	assert(!timeout);
 	assert(!uaddr2);
 	assert(!val3);
 
+	if (timeout) {
+		timeout_ms = timeout->tv_sec * 1000
+			+ (timeout->tv_nsec + 999999) / 1000000;
+		gettimeofday(&start, NULL);
+	}
+
 	/*
 	 * Ensure previous memory operations on uaddr have completed.
 	 */
@@ -102,8 +153,16 @@ int compat_futex_async(int32_t *uaddr, int op, int32_t val,
 
 	switch (op) {
 	case FUTEX_WAIT:
-		while (*uaddr == val)
-			poll(NULL, 0, 10);
+		while (*uaddr == val) {
+			if (!timeout) {
+				poll(NULL, 0, 10);
+				continue;
+			}
+			remain_ms = timeout_ms - compat_futex_elapsed_ms(&start);
+			if (remain_ms <= 0)
+				return -ETIMEDOUT;
+			poll(NULL, 0, remain_ms < 10 ? remain_ms : 10);
+		}
 		break;
 	case FUTEX_WAKE:
 		break;
@@ -55,6 +55,7 @@ do {								\
 #endif
 
 struct ht_items_count;
+struct resize_pool;
 
 /*
  * cds_lfht: Top-level data structure representing a lock-free hash
@@ -82,9 +83,15 @@ struct cds_lfht {
 	 */
 	pthread_mutex_t resize_mutex;	/* resize mutex: add/del mutex */
 	pthread_attr_t *resize_attr;	/* Resize threads attributes */
+	struct resize_pool *resize_pool;	/* Resize worker threads */
 	unsigned int in_progress_resize, in_progress_destroy;
 	unsigned long resize_target;
 	int resize_initiated;
+	/* Nodes being linked by cds_lfht_bulk_load, under resize mutex */
+	struct cds_lfht_node **bulk_nodes;
+	unsigned long nr_bulk_nodes;
+	/* CDS_LFHT_INCREMENTAL_RESIZE slice size and pause */
+	unsigned long resize_slice, resize_pause_us;
 
 	/*
 	 * Variables needed for add and remove fast-paths.
@@ -104,6 +111,19 @@ struct cds_lfht {
 	 */
 	struct cds_lfht_node *(*bucket_at)(struct cds_lfht *ht,
 			unsigned long index);
+	/*
+	 * With CDS_LFHT_BUCKET_TAGS, per order-index-level bucket tag
+	 * tables, laid out as tbl_order, and their sequence count, odd
+	 * while a resize is in progress.
+	 */
+	unsigned long *tbl_tags[MAX_TABLE_ORDER];
+	unsigned long tags_seq;
+	/*
+	 * With CDS_LFHT_INCREMENTAL_RESIZE, bucket indexes of the order
+	 * being grown: next to initialize, end of the order, and count
+	 * of the initialized ones.
+	 */
+	unsigned long resize_next, resize_limit, resize_done;
 	/*
 	 * Dynamic length "tbl_chunk" needs to be at the end of
 	 * cds_lfht.
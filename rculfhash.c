@@ -204,6 +204,26 @@
  * * Writes are lock-free. Any retry loop performed by a write operation
  *   is triggered by progress made within another update operation.
  *
+ * Bucket tags:
+ *
+ * With CDS_LFHT_BUCKET_TAGS, a tag word is kept for each bucket, with
+ * one bit set per hash value found in the bucket, chosen by the hash
+ * bits above the bucket index (the low bits of the reverse hash). A
+ * lookup for a hash whose bit is clear in its bucket tag completes
+ * without walking the chain: a tag table holds 8 words per cache line,
+ * where the bucket node table holds 4 nodes, and the chain nodes are
+ * not touched at all.
+ *
+ * Tags only summarize the nodes of a bucket: bits are set by add, but
+ * never cleared by del, as there is no lock-free way to know whether
+ * another node of the bucket still needs the bit. Stale bits only cost
+ * chain walks. An add sets the bit in its bucket, and in every bucket
+ * node it walks past, before reading the node it is linked after. A
+ * new bucket node copies the tag of its parent once linked, and a
+ * removed bucket node merges its tag into its parent once all adds have
+ * moved to the smaller size. Resizes make ->tags_seq odd, and lookups
+ * only trust a tag read while it stays even.
+ *
  * Bucket node tables:
  *
  * hash table	hash table	the last	all bucket node tables
@@ -264,6 +284,7 @@
 #include <stdint.h>
 #include <string.h>
 #include <sched.h>
+#include <time.h>
 
 #include "config.h"
 #include <urcu.h>
@@ -273,6 +294,7 @@
 #include <urcu/uatomic.h>
 #include <urcu/compiler.h>
 #include <urcu/rculfhash.h>
+#include <urcu/list.h>
 #include <rculfhash-internal.h>
 #include <stdio.h>
 #include <pthread.h>
@@ -300,6 +322,17 @@
 #define MIN_PARTITION_PER_THREAD_ORDER	12
 #define MIN_PARTITION_PER_THREAD	(1UL << MIN_PARTITION_PER_THREAD_ORDER)
 
+/*
+ * Number of bucket nodes initialized by each update of a table growing
+ * incrementally.
+ */
+#define RESIZE_HELP_BUCKETS		16
+
+/*
+ * Number of lookups of cds_lfht_lookup_batch() in progress at once.
+ */
+#define LOOKUP_BATCH_INFLIGHT		16
+
 /*
  * The removed flag needs to be updated atomically with the pointer.
  * It indicates that no node must attach to the node scheduled for
@@ -344,18 +377,47 @@ struct rcu_resize_work {
 };
 
 /*
- * partition_resize_work: Contains arguments passed to worker threads
- * executing the hash table resize on partitions of the hash table
- * assigned to each processor's worker thread.
+ * partition_resize_work: Contains arguments passed to the resize worker
+ * threads executing the hash table resize on partitions of the hash
+ * table. The partitions are claimed one at a time, in order, by the
+ * thread resizing the table and by the worker threads which take the
+ * work from the queue of their pool.
  */
 struct partition_resize_work {
-	pthread_t thread_id;
+	struct cds_list_head list;	/* in pool queue, while queued */
+	int queued;
+	unsigned long nr_users;		/* worker threads using the work */
 	struct cds_lfht *ht;
-	unsigned long i, start, len;
+	unsigned long i, len, partition_len;
+	unsigned long next_start;	/* next partition to claim */
 	void (*fct)(struct cds_lfht *ht, unsigned long i,
 		    unsigned long start, unsigned long len);
 };
 
+/*
+ * resize_pool: Long-lived resize worker threads, shared by the hash
+ * tables with the same resize thread attributes. The pool goes away,
+ * with its worker threads, when its last hash table is destroyed.
+ */
+struct resize_pool {
+	struct cds_list_head list;	/* in resize_pools */
+	pthread_attr_t *attr;
+	unsigned long refcount;		/* hash tables using the pool */
+	int stop;			/* last hash table destroyed */
+	unsigned long nr_threads;	/* worker threads not exiting */
+	struct cds_list_head workers;	/* resize_worker, until joined */
+	struct cds_list_head queue;	/* partition_resize_work */
+	pthread_cond_t work_cond;	/* work queued, or fewer workers */
+	pthread_cond_t done_cond;	/* worker done with a work */
+};
+
+struct resize_worker {
+	struct cds_list_head list;	/* in pool workers */
+	struct resize_pool *pool;
+	pthread_t thread_id;
+	int exited;			/* ready to be joined */
+};
+
 /*
  * Algorithm to reverse bits in a word by lookup table, extended to
  * 64-bit words.
@@ -560,8 +622,19 @@ void cds_lfht_resize_lazy_count(struct cds_lfht *ht, unsigned long size,
 				unsigned long count);
 
 static long nr_cpus_mask = -1;
+static long nr_cpus = -1;	/* Configured CPUs, set with nr_cpus_mask. */
 static long split_count_mask = -1;
 
+/*
+ * Resize worker pools, protected by resize_pool_mutex. Unless set by
+ * cds_lfht_set_resize_workers(), there is one worker thread per
+ * additional CPU.
+ */
+static pthread_mutex_t resize_pool_mutex = PTHREAD_MUTEX_INITIALIZER;
+static CDS_LIST_HEAD(resize_pools);
+static long resize_nr_workers = -1;
+static int resize_pool_atfork;
+
 #if defined(HAVE_SYSCONF)
 static void ht_init_nr_cpus_mask(void)
 {
@@ -572,6 +645,7 @@ static void ht_init_nr_cpus_mask(void)
 		nr_cpus_mask = -2;
 		return;
 	}
+	nr_cpus = maxcpus;
 	/*
 	 * round up number of CPUs to next power of two, so we
 	 * can use & for modulo.
@@ -791,9 +865,38 @@ unsigned long _uatomic_xchg_monotonic_increase(unsigned long *ptr,
 	return old2;
 }
 
+/*
+ * Bucket tag tables follow the layout of the order memory management
+ * plugin, whatever the plugin used for bucket nodes.
+ */
+static
+void alloc_bucket_tags(struct cds_lfht *ht, unsigned long order)
+{
+	if (order == 0) {
+		ht->tbl_tags[0] = calloc(ht->min_nr_alloc_buckets,
+			sizeof(unsigned long));
+		assert(ht->tbl_tags[0]);
+	} else if (order > ht->min_alloc_buckets_order) {
+		ht->tbl_tags[order] = calloc(1UL << (order - 1),
+			sizeof(unsigned long));
+		assert(ht->tbl_tags[order]);
+	}
+}
+
+static
+void free_bucket_tags(struct cds_lfht *ht, unsigned long order)
+{
+	if (order == 0)
+		poison_free(ht->tbl_tags[0]);
+	else if (order > ht->min_alloc_buckets_order)
+		poison_free(ht->tbl_tags[order]);
+}
+
 static
 void cds_lfht_alloc_bucket_table(struct cds_lfht *ht, unsigned long order)
 {
+	if (ht->flags & CDS_LFHT_BUCKET_TAGS)
+		alloc_bucket_tags(ht, order);
 	return ht->mm->alloc_bucket_table(ht, order);
 }
 
@@ -805,6 +908,8 @@ void cds_lfht_alloc_bucket_table(struct cds_lfht *ht, unsigned long order)
 static
 void cds_lfht_free_bucket_table(struct cds_lfht *ht, unsigned long order)
 {
+	if (ht->flags & CDS_LFHT_BUCKET_TAGS)
+		free_bucket_tags(ht, order);
 	return ht->mm->free_bucket_table(ht, order);
 }
 
@@ -822,6 +927,78 @@ struct cds_lfht_node *lookup_bucket(struct cds_lfht *ht, unsigned long size,
 	return bucket_at(ht, hash & (size - 1));
 }
 
+static inline
+unsigned long *tags_at(struct cds_lfht *ht, unsigned long index)
+{
+	unsigned long order;
+
+	if (index < ht->min_nr_alloc_buckets)
+		return &ht->tbl_tags[0][index];
+	order = cds_lfht_fls_ulong(index);
+	return &ht->tbl_tags[order][index & ((1UL << (order - 1)) - 1)];
+}
+
+/* Tag bit of a hash: hash bits above the bucket index come first. */
+static inline
+unsigned long hash_tag(unsigned long reverse_hash)
+{
+	return 1UL << (reverse_hash & (CAA_BITS_PER_LONG - 1));
+}
+
+/*
+ * Set the tag bit of an added node in the tag of a bucket, before the
+ * node following this bucket node is read.
+ */
+static
+void bucket_tags_add(struct cds_lfht *ht, unsigned long index,
+		unsigned long tag)
+{
+	unsigned long *tags = tags_at(ht, index);
+
+	if (CMM_LOAD_SHARED(*tags) & tag)
+		return;
+	uatomic_or(tags, tag);
+	cmm_smp_mb__after_uatomic_or();
+}
+
+/*
+ * Merge the tag of bucket "from" into bucket "to": used by resize once
+ * the new bucket node is linked, or the removed bucket node is no
+ * longer used as add starting point.
+ */
+static
+void bucket_tags_merge(struct cds_lfht *ht, unsigned long to,
+		unsigned long from)
+{
+	unsigned long tags = CMM_LOAD_SHARED(*tags_at(ht, from));
+
+	if ((CMM_LOAD_SHARED(*tags_at(ht, to)) & tags) != tags)
+		uatomic_or(tags_at(ht, to), tags);
+}
+
+/*
+ * Returns nonzero if the bucket tag "tags", for a lookup which read the
+ * table size beforehand, shows the bucket has no node with
+ * "reverse_hash".
+ */
+static inline
+int bucket_tags_miss(struct cds_lfht *ht, unsigned long *tags_p,
+		unsigned long reverse_hash)
+{
+	unsigned long seq, tags;
+
+	cmm_smp_rmb();	/* read size before tags_seq */
+	seq = CMM_LOAD_SHARED(ht->tags_seq);
+	if (seq & 1)
+		return 0;
+	cmm_smp_rmb();	/* read tags_seq before tags */
+	tags = CMM_LOAD_SHARED(*tags_p);
+	if (tags & hash_tag(reverse_hash))
+		return 0;
+	cmm_smp_rmb();	/* read tags before tags_seq */
+	return CMM_LOAD_SHARED(ht->tags_seq) == seq;
+}
+
 /*
  * Remove all logically deleted nodes from a bucket up to a certain node key.
  */
@@ -952,10 +1129,15 @@ void _cds_lfht_add(struct cds_lfht *ht,
 	struct cds_lfht_node *iter_prev, *iter, *next, *new_node, *new_next,
 			*return_node;
 	struct cds_lfht_node *bucket;
+	unsigned long tag = 0;
 
 	assert(!is_bucket(node));
 	assert(!is_removed(node));
 	bucket = lookup_bucket(ht, size, hash);
+	if ((ht->flags & CDS_LFHT_BUCKET_TAGS) && !bucket_flag) {
+		tag = hash_tag(node->reverse_hash);
+		bucket_tags_add(ht, hash & (size - 1), tag);
+	}
 	for (;;) {
 		uint32_t chain_len = 0;
 
@@ -981,6 +1163,12 @@ void _cds_lfht_add(struct cds_lfht *ht,
 			if (caa_unlikely(is_removed(next)))
 				goto gc_node;
 
+			/* Bucket node of a larger size than ours */
+			if (tag && is_bucket(next))
+				bucket_tags_add(ht,
+					bit_reverse_ulong(clear_flag(iter)->reverse_hash),
+					tag);
+
 			/* uniquely add */
 			if (unique_ret
 			    && !is_bucket(next)
@@ -1115,57 +1303,318 @@ int _cds_lfht_del(struct cds_lfht *ht, unsigned long size,
 		return -ENOENT;
 }
 
+/*
+ * Execute partitions of the work until none is left to claim. The
+ * partitions are large enough for the claims to be rare.
+ */
 static
-void *partition_resize_thread(void *arg)
+void partition_resize_run(struct partition_resize_work *work)
 {
-	struct partition_resize_work *work = arg;
+	unsigned long start;
+
+	for (;;) {
+		start = uatomic_add_return(&work->next_start,
+				work->partition_len) - work->partition_len;
+		if (start >= work->len)
+			break;
+		work->fct(work->ht, work->i, start, work->partition_len);
+	}
+}
+
+/* Called with resize_pool_mutex held. */
+static
+void partition_resize_dequeue(struct partition_resize_work *work)
+{
+	if (work->queued) {
+		cds_list_del(&work->list);
+		work->queued = 0;
+	}
+}
+
+static
+long resize_pool_nr_workers(void)
+{
+	if (resize_nr_workers >= 0)
+		return resize_nr_workers;
+	return nr_cpus > 1 ? nr_cpus - 1 : 0;
+}
+
+static
+void *resize_pool_thread(void *arg)
+{
+	struct resize_worker *worker = arg;
+	struct resize_pool *pool = worker->pool;
+	struct partition_resize_work *work;
+	int ret;
 
-	work->ht->flavor->register_thread();
-	work->fct(work->ht, work->i, work->start, work->len);
-	work->ht->flavor->unregister_thread();
+	ret = pthread_mutex_lock(&resize_pool_mutex);
+	assert(!ret);
+	for (;;) {
+		if (pool->stop || pool->nr_threads > resize_pool_nr_workers())
+			break;
+		if (cds_list_empty(&pool->queue)) {
+			ret = pthread_cond_wait(&pool->work_cond,
+					&resize_pool_mutex);
+			assert(!ret);
+			continue;
+		}
+		work = cds_list_first_entry(&pool->queue,
+				struct partition_resize_work, list);
+		work->nr_users++;
+		ret = pthread_mutex_unlock(&resize_pool_mutex);
+		assert(!ret);
+
+		work->ht->flavor->register_thread();
+		partition_resize_run(work);
+		work->ht->flavor->unregister_thread();
+
+		ret = pthread_mutex_lock(&resize_pool_mutex);
+		assert(!ret);
+		/* No partition left to claim */
+		partition_resize_dequeue(work);
+		if (!--work->nr_users) {
+			ret = pthread_cond_broadcast(&pool->done_cond);
+			assert(!ret);
+		}
+	}
+	pool->nr_threads--;
+	worker->exited = 1;
+	ret = pthread_mutex_unlock(&resize_pool_mutex);
+	assert(!ret);
 	return NULL;
 }
 
+static
+void resize_pool_before_fork(void)
+{
+	int ret;
+
+	ret = pthread_mutex_lock(&resize_pool_mutex);
+	assert(!ret);
+}
+
+static
+void resize_pool_after_fork_parent(void)
+{
+	int ret;
+
+	ret = pthread_mutex_unlock(&resize_pool_mutex);
+	assert(!ret);
+}
+
+/* The worker threads do not exist in the child. */
+static
+void resize_pool_after_fork_child(void)
+{
+	struct resize_pool *pool;
+	struct resize_worker *worker, *tmp;
+	int ret;
+
+	cds_list_for_each_entry(pool, &resize_pools, list) {
+		cds_list_for_each_entry_safe(worker, tmp, &pool->workers, list)
+			free(worker);
+		CDS_INIT_LIST_HEAD(&pool->workers);
+		pool->nr_threads = 0;
+		CDS_INIT_LIST_HEAD(&pool->queue);
+	}
+	ret = pthread_mutex_unlock(&resize_pool_mutex);
+	assert(!ret);
+}
+
+/*
+ * Get a reference on the pool of the resize thread attributes "attr",
+ * created without worker threads if none exists. Returns NULL if the
+ * pool cannot be created: resizes are then left to the thread resizing.
+ */
+static
+struct resize_pool *resize_pool_get(pthread_attr_t *attr)
+{
+	struct resize_pool *pool;
+	int ret;
+
+	ret = pthread_mutex_lock(&resize_pool_mutex);
+	assert(!ret);
+	cds_list_for_each_entry(pool, &resize_pools, list) {
+		if (pool->attr == attr)
+			goto found;
+	}
+	if (!resize_pool_atfork) {
+		ret = pthread_atfork(resize_pool_before_fork,
+				resize_pool_after_fork_parent,
+				resize_pool_after_fork_child);
+		if (ret) {
+			pool = NULL;
+			goto end;
+		}
+		resize_pool_atfork = 1;
+	}
+	pool = calloc(1, sizeof(*pool));
+	if (!pool)
+		goto end;
+	pool->attr = attr;
+	CDS_INIT_LIST_HEAD(&pool->workers);
+	CDS_INIT_LIST_HEAD(&pool->queue);
+	ret = pthread_cond_init(&pool->work_cond, NULL);
+	assert(!ret);
+	ret = pthread_cond_init(&pool->done_cond, NULL);
+	assert(!ret);
+	cds_list_add(&pool->list, &resize_pools);
+found:
+	pool->refcount++;
+end:
+	ret = pthread_mutex_unlock(&resize_pool_mutex);
+	assert(!ret);
+	return pool;
+}
+
+/*
+ * Release a reference on the pool. The last reference stops and joins
+ * the worker threads, so none is left running once the last hash table
+ * of the pool is destroyed.
+ */
+static
+void resize_pool_put(struct resize_pool *pool)
+{
+	struct resize_worker *worker, *tmp;
+	int ret;
+
+	ret = pthread_mutex_lock(&resize_pool_mutex);
+	assert(!ret);
+	if (--pool->refcount) {
+		ret = pthread_mutex_unlock(&resize_pool_mutex);
+		assert(!ret);
+		return;
+	}
+	assert(cds_list_empty(&pool->queue));
+	cds_list_del(&pool->list);
+	pool->stop = 1;
+	ret = pthread_cond_broadcast(&pool->work_cond);
+	assert(!ret);
+	ret = pthread_mutex_unlock(&resize_pool_mutex);
+	assert(!ret);
+
+	/* Unreachable from resize_pools: the workers list is ours. */
+	cds_list_for_each_entry_safe(worker, tmp, &pool->workers, list) {
+		ret = pthread_join(worker->thread_id, NULL);
+		assert(!ret);
+		free(worker);
+	}
+	ret = pthread_cond_destroy(&pool->work_cond);
+	assert(!ret);
+	ret = pthread_cond_destroy(&pool->done_cond);
+	assert(!ret);
+	free(pool);
+}
+
+/*
+ * Join the worker threads which exited, then create at most
+ * "nr_threads" more worker threads if the pool has fewer than wanted.
+ * Called with resize_pool_mutex held.
+ */
+static
+void resize_pool_spawn(struct resize_pool *pool, unsigned long nr_threads)
+{
+	struct resize_worker *worker, *tmp;
+	int ret;
+
+	cds_list_for_each_entry_safe(worker, tmp, &pool->workers, list) {
+		if (!worker->exited)
+			continue;
+		ret = pthread_join(worker->thread_id, NULL);
+		assert(!ret);
+		cds_list_del(&worker->list);
+		free(worker);
+	}
+	nr_threads = min(nr_threads, resize_pool_nr_workers());
+	while (pool->nr_threads < nr_threads) {
+		worker = calloc(1, sizeof(*worker));
+		if (!worker)
+			break;
+		worker->pool = pool;
+		ret = pthread_create(&worker->thread_id, pool->attr,
+				resize_pool_thread, worker);
+		if (ret) {
+			dbg_printf("error creating resize worker thread\n");
+			free(worker);
+			break;
+		}
+		cds_list_add(&worker->list, &pool->workers);
+		pool->nr_threads++;
+	}
+}
+
+void cds_lfht_set_resize_workers(unsigned long nr_workers)
+{
+	struct resize_pool *pool;
+	int ret;
+
+	ret = pthread_mutex_lock(&resize_pool_mutex);
+	assert(!ret);
+	resize_nr_workers = nr_workers;
+	/* Let the workers in excess exit. */
+	cds_list_for_each_entry(pool, &resize_pools, list) {
+		ret = pthread_cond_broadcast(&pool->work_cond);
+		assert(!ret);
+	}
+	ret = pthread_mutex_unlock(&resize_pool_mutex);
+	assert(!ret);
+}
+
+/*
+ * Split the work in partitions of the minimum partition size, executed
+ * by the calling thread and by the resize worker threads of the pool
+ * of ht->resize_attr, each claiming the next partition once done with
+ * the previous one, so threads delayed by concurrent updates or by
+ * the scheduler do not delay the others. Called with the calling
+ * thread offline, as with the resize mutex held.
+ */
 static
 void partition_resize_helper(struct cds_lfht *ht, unsigned long i,
 		unsigned long len,
 		void (*fct)(struct cds_lfht *ht, unsigned long i,
 			unsigned long start, unsigned long len))
 {
-	unsigned long partition_len;
-	struct partition_resize_work *work;
-	int thread, ret;
-	unsigned long nr_threads;
+	struct partition_resize_work work;
+	struct resize_pool *pool;
+	int ret;
 
-	/*
-	 * Note: nr_cpus_mask + 1 is always power of 2.
-	 * We spawn just the number of threads we need to satisfy the minimum
-	 * partition size, up to the number of CPUs in the system.
-	 */
-	if (nr_cpus_mask > 0) {
-		nr_threads = min(nr_cpus_mask + 1,
-				 len >> MIN_PARTITION_PER_THREAD_ORDER);
-	} else {
-		nr_threads = 1;
-	}
-	partition_len = len >> cds_lfht_get_count_order_ulong(nr_threads);
-	work = calloc(nr_threads, sizeof(*work));
-	assert(work);
-	for (thread = 0; thread < nr_threads; thread++) {
-		work[thread].ht = ht;
-		work[thread].i = i;
-		work[thread].len = partition_len;
-		work[thread].start = thread * partition_len;
-		work[thread].fct = fct;
-		ret = pthread_create(&(work[thread].thread_id), ht->resize_attr,
-			partition_resize_thread, &work[thread]);
+	work.ht = ht;
+	work.i = i;
+	work.len = len;
+	work.partition_len = min(len, MIN_PARTITION_PER_THREAD);
+	work.next_start = 0;
+	work.nr_users = 0;
+	work.queued = 0;
+	work.fct = fct;
+
+	pool = ht->resize_pool;
+	ret = pthread_mutex_lock(&resize_pool_mutex);
+	assert(!ret);
+	if (pool)
+		resize_pool_spawn(pool,
+			(len >> MIN_PARTITION_PER_THREAD_ORDER) - 1);
+	if (pool && pool->nr_threads) {
+		cds_list_add_tail(&work.list, &pool->queue);
+		work.queued = 1;
+		ret = pthread_cond_broadcast(&pool->work_cond);
 		assert(!ret);
 	}
-	for (thread = 0; thread < nr_threads; thread++) {
-		ret = pthread_join(work[thread].thread_id, NULL);
+	ret = pthread_mutex_unlock(&resize_pool_mutex);
+	assert(!ret);
+
+	ht->flavor->thread_online();
+	partition_resize_run(&work);
+	ht->flavor->thread_offline();
+
+	ret = pthread_mutex_lock(&resize_pool_mutex);
+	assert(!ret);
+	partition_resize_dequeue(&work);
+	while (work.nr_users) {
+		ret = pthread_cond_wait(&pool->done_cond, &resize_pool_mutex);
 		assert(!ret);
 	}
-	free(work);
+	ret = pthread_mutex_unlock(&resize_pool_mutex);
+	assert(!ret);
 }
 
 /*
@@ -1195,15 +1644,128 @@ void init_table_populate_partition(struct cds_lfht *ht, unsigned long i,
 			   i, j, j);
 		new_node->reverse_hash = bit_reverse_ulong(j);
 		_cds_lfht_add(ht, j, NULL, NULL, size, new_node, NULL, 1);
+		if (ht->flags & CDS_LFHT_BUCKET_TAGS) {
+			/* Link bucket node before reading the parent tag */
+			cmm_smp_mb();
+			bucket_tags_merge(ht, j, j - size);
+		}
 	}
 	ht->flavor->read_unlock();
 }
 
+/*
+ * Claim the next bucket nodes to initialize, at most nr_buckets, of the
+ * order being grown incrementally: [*start, *end). Returns 0 if there
+ * is none.
+ *
+ * resize_next only moves backward when the thread resizing opens an
+ * order after a shrink, which waits for a grace period: updaters
+ * claiming within a RCU read-side critical section cannot see the same
+ * resize_next value for two different orders.
+ */
+static
+int resize_claim(struct cds_lfht *ht, unsigned long nr_buckets,
+		unsigned long *start, unsigned long *end)
+{
+	unsigned long next, limit, ret;
+
+	next = CMM_LOAD_SHARED(ht->resize_next);
+	for (;;) {
+		cmm_smp_rmb();	/* read resize_next before resize_limit */
+		limit = CMM_LOAD_SHARED(ht->resize_limit);
+		if (next >= limit)
+			return 0;
+		ret = uatomic_cmpxchg(&ht->resize_next, next,
+				min(next + nr_buckets, limit));
+		if (ret == next)
+			break;
+		next = ret;
+	}
+	*start = next;
+	*end = min(next + nr_buckets, limit);
+	return 1;
+}
+
+static
+void resize_populate(struct cds_lfht *ht, unsigned long start,
+		unsigned long end)
+{
+	unsigned long i = cds_lfht_fls_ulong(start);
+
+	init_table_populate_partition(ht, i, start - (1UL << (i - 1)),
+			end - start);
+	cmm_smp_mb__before_uatomic_add();
+	uatomic_add(&ht->resize_done, end - start);
+}
+
+/*
+ * Initialize a few bucket nodes of a table growing incrementally.
+ * Called by updaters, with RCU read lock held.
+ */
+static
+void cds_lfht_resize_help(struct cds_lfht *ht)
+{
+	unsigned long start, end;
+
+	if (!(ht->flags & CDS_LFHT_INCREMENTAL_RESIZE))
+		return;
+	if (caa_likely(!resize_claim(ht, RESIZE_HELP_BUCKETS, &start, &end)))
+		return;
+	resize_populate(ht, start, end);
+}
+
+/* Pause of the thread resizing between slices, in quiescent state. */
+static
+void resize_pause(struct cds_lfht *ht)
+{
+	unsigned long pause_us = CMM_LOAD_SHARED(ht->resize_pause_us);
+	struct timespec ts;
+
+	if (!pause_us) {
+		(void) sched_yield();
+		return;
+	}
+	ts.tv_sec = pause_us / 1000000;
+	ts.tv_nsec = (pause_us % 1000000) * 1000;
+	(void) nanosleep(&ts, NULL);
+}
+
+static
+void init_table_populate_incremental(struct cds_lfht *ht, unsigned long i,
+				     unsigned long len)
+{
+	unsigned long start, end;
+
+	/* Close the previous order before moving resize_next back. */
+	CMM_STORE_SHARED(ht->resize_limit, len);
+	cmm_smp_wmb();
+	CMM_STORE_SHARED(ht->resize_next, len);
+	CMM_STORE_SHARED(ht->resize_done, len);
+	cmm_smp_wmb();	/* bucket node table and claims before limit */
+	CMM_STORE_SHARED(ht->resize_limit, len << 1);
+
+	while (resize_claim(ht, CMM_LOAD_SHARED(ht->resize_slice),
+			&start, &end)) {
+		ht->flavor->thread_online();
+		resize_populate(ht, start, end);
+		ht->flavor->thread_offline();
+		resize_pause(ht);
+	}
+	/* Wait for the updaters initializing the last bucket nodes. */
+	while (CMM_LOAD_SHARED(ht->resize_done) != len << 1)
+		(void) sched_yield();
+	cmm_smp_mb();	/* read resize_done before size update */
+}
+
 static
 void init_table_populate(struct cds_lfht *ht, unsigned long i,
 			 unsigned long len)
 {
 	assert(nr_cpus_mask != -1);
+	if (ht->flags & CDS_LFHT_INCREMENTAL_RESIZE) {
+		init_table_populate_incremental(ht, i, len);
+		return;
+	}
 	if (nr_cpus_mask < 0 || len < 2 * MIN_PARTITION_PER_THREAD) {
 		ht->flavor->thread_online();
 		init_table_populate_partition(ht, i, 0, len);
@@ -1295,6 +1857,8 @@ void remove_table_partition(struct cds_lfht *ht, unsigned long i,
 		/* Set the REMOVED_FLAG to freeze the ->next for gc */
 		uatomic_or(&fini_bucket->next, REMOVED_FLAG);
 		_cds_lfht_gc_bucket(parent_bucket, fini_bucket);
+		if (ht->flags & CDS_LFHT_BUCKET_TAGS)
+			bucket_tags_merge(ht, j - size, j);
 	}
 	ht->flavor->read_unlock();
 }
@@ -1304,6 +1868,19 @@ void remove_table(struct cds_lfht *ht, unsigned long i, unsigned long len)
 {
 
 	assert(nr_cpus_mask != -1);
+	if (ht->flags & CDS_LFHT_INCREMENTAL_RESIZE) {
+		unsigned long start, slice;
+
+		for (start = 0; start < len; start += slice) {
+			slice = min(CMM_LOAD_SHARED(ht->resize_slice),
+				    len - start);
+			ht->flavor->thread_online();
+			remove_table_partition(ht, i, start, slice);
+			ht->flavor->thread_offline();
+			resize_pause(ht);
+		}
+		return;
+	}
 	if (nr_cpus_mask < 0 || len < 2 * MIN_PARTITION_PER_THREAD) {
 		ht->flavor->thread_online();
 		remove_table_partition(ht, i, 0, len);
@@ -1480,16 +2057,31 @@ struct cds_lfht *_cds_lfht_new(unsigned long init_size,
 	ht->flags = flags;
 	ht->flavor = flavor;
 	ht->resize_attr = attr;
+	ht->resize_pool = resize_pool_get(attr);
 	alloc_split_items_count(ht);
 	/* this mutex should not nest in read-side C.S. */
 	pthread_mutex_init(&ht->resize_mutex, NULL);
 	order = cds_lfht_get_count_order_ulong(init_size);
 	ht->resize_target = 1UL << order;
+	ht->resize_slice = MIN_PARTITION_PER_THREAD;
 	cds_lfht_create_bucket(ht, 1UL << order);
+	ht->resize_next = ht->resize_limit = ht->resize_done = 1UL << order;
 	ht->size = 1UL << order;
 	return ht;
 }
 
+int cds_lfht_set_resize_slice(struct cds_lfht *ht, unsigned long nr_buckets,
+		unsigned long pause_us)
+{
+	if (!nr_buckets || !(ht->flags & CDS_LFHT_INCREMENTAL_RESIZE)) {
+		errno = EINVAL;
+		return -EINVAL;
+	}
+	CMM_STORE_SHARED(ht->resize_slice, nr_buckets);
+	CMM_STORE_SHARED(ht->resize_pause_us, pause_us);
+	return 0;
+}
+
 void cds_lfht_lookup(struct cds_lfht *ht, unsigned long hash,
 		cds_lfht_match_fct match, const void *key,
 		struct cds_lfht_iter *iter)
@@ -1500,6 +2092,12 @@ void cds_lfht_lookup(struct cds_lfht *ht, unsigned long hash,
 	reverse_hash = bit_reverse_ulong(hash);
 
 	size = rcu_dereference(ht->size);
+	if ((ht->flags & CDS_LFHT_BUCKET_TAGS)
+	    && bucket_tags_miss(ht, tags_at(ht, hash & (size - 1)),
+			reverse_hash)) {
+		iter->node = iter->next = NULL;
+		return;
+	}
 	bucket = lookup_bucket(ht, size, hash);
 	/* We can always skip the bucket node initially */
 	node = rcu_dereference(bucket->next);
@@ -1528,6 +2126,120 @@ void cds_lfht_lookup(struct cds_lfht *ht, unsigned long hash,
 	iter->next = next;
 }
 
+/*
+ * Lookup of a batch in progress. tags and bucket are reset once the
+ * bucket tag and the bucket node are read.
+ */
+struct lookup_batch_state {
+	unsigned long index;
+	unsigned long reverse_hash;
+	unsigned long *tags;
+	struct cds_lfht_node *bucket, *node;
+};
+
+static
+void lookup_batch_start(struct cds_lfht *ht, unsigned long size,
+		const struct cds_lfht_lookup_key *keys,
+		struct lookup_batch_state *state, unsigned long index)
+{
+	state->index = index;
+	state->reverse_hash = bit_reverse_ulong(keys[index].hash);
+	state->bucket = lookup_bucket(ht, size, keys[index].hash);
+	if (ht->flags & CDS_LFHT_BUCKET_TAGS) {
+		state->tags = tags_at(ht, keys[index].hash & (size - 1));
+		__builtin_prefetch(state->tags);
+	} else {
+		state->tags = NULL;
+		__builtin_prefetch(state->bucket);
+	}
+}
+
+/*
+ * Move the lookup one node forward, as cds_lfht_lookup() does, and
+ * prefetch the following node. Returns nonzero once the lookup
+ * completes.
+ */
+static
+int lookup_batch_step(struct cds_lfht *ht, cds_lfht_match_fct match,
+		const struct cds_lfht_lookup_key *keys,
+		struct cds_lfht_iter *iters,
+		struct lookup_batch_state *state)
+{
+	struct cds_lfht_iter *iter = &iters[state->index];
+	struct cds_lfht_node *node, *next;
+
+	if (state->tags) {
+		if (bucket_tags_miss(ht, state->tags, state->reverse_hash)) {
+			iter->node = iter->next = NULL;
+			return 1;
+		}
+		state->tags = NULL;
+		__builtin_prefetch(state->bucket);
+		return 0;
+	} else if (state->bucket) {
+		/* We can always skip the bucket node initially */
+		node = rcu_dereference(state->bucket->next);
+		node = clear_flag(node);
+		state->bucket = NULL;
+	} else {
+		node = state->node;
+		if (caa_unlikely(is_end(node))
+		    || caa_unlikely(node->reverse_hash > state->reverse_hash)) {
+			iter->node = iter->next = NULL;
+			return 1;
+		}
+		next = rcu_dereference(node->next);
+		assert(node == clear_flag(node));
+		if (caa_likely(!is_removed(next))
+		    && !is_bucket(next)
+		    && node->reverse_hash == state->reverse_hash
+		    && caa_likely(match(node, keys[state->index].key))) {
+			assert(!is_bucket(CMM_LOAD_SHARED(node->next)));
+			iter->node = node;
+			iter->next = next;
+			return 1;
+		}
+		node = clear_flag(next);
+	}
+	if (!is_end(node))
+		__builtin_prefetch(node);
+	state->node = node;
+	return 0;
+}
+
+void cds_lfht_lookup_batch(struct cds_lfht *ht, cds_lfht_match_fct match,
+		const struct cds_lfht_lookup_key *keys, unsigned long nr_keys,
+		struct cds_lfht_iter *iters)
+{
+	struct lookup_batch_state state[LOOKUP_BATCH_INFLIGHT];
+	unsigned long size, next_key = 0;
+	unsigned int i, nr_inflight = 0;
+
+	size = rcu_dereference(ht->size);
+	while (nr_inflight < LOOKUP_BATCH_INFLIGHT && next_key < nr_keys)
+		lookup_batch_start(ht, size, keys, &state[nr_inflight++],
+				next_key++);
+	/*
+	 * Step each lookup in turn: the node it reads was prefetched
+	 * while the other lookups were stepped. A completed lookup makes
+	 * room for the next key.
+	 */
+	while (nr_inflight) {
+		for (i = 0; i < nr_inflight;) {
+			if (!lookup_batch_step(ht, match, keys, iters,
+					&state[i])) {
+				i++;
+			} else if (next_key < nr_keys) {
+				lookup_batch_start(ht, size, keys, &state[i],
+						next_key++);
+				i++;
+			} else {
+				state[i] = state[--nr_inflight];
+			}
+		}
+	}
+}
+
 void cds_lfht_next_duplicate(struct cds_lfht *ht, cds_lfht_match_fct match,
 		const void *key, struct cds_lfht_iter *iter)
 {
@@ -1602,6 +2314,7 @@ void cds_lfht_add(struct cds_lfht *ht, unsigned long hash,
 	size = rcu_dereference(ht->size);
 	_cds_lfht_add(ht, hash, NULL, NULL, size, node, NULL, 0);
 	ht_count_add(ht, size, hash);
+	cds_lfht_resize_help(ht);
 }
 
 struct cds_lfht_node *cds_lfht_add_unique(struct cds_lfht *ht,
@@ -1618,6 +2331,7 @@ struct cds_lfht_node *cds_lfht_add_unique(struct cds_lfht *ht,
 	_cds_lfht_add(ht, hash, match, key, size, node, &iter, 0);
 	if (iter.node == node)
 		ht_count_add(ht, size, hash);
+	cds_lfht_resize_help(ht);
 	return iter.node;
 }
 
@@ -1636,11 +2350,14 @@ struct cds_lfht_node *cds_lfht_add_replace(struct cds_lfht *ht,
 		_cds_lfht_add(ht, hash, match, key, size, node, &iter, 0);
 		if (iter.node == node) {
 			ht_count_add(ht, size, hash);
+			cds_lfht_resize_help(ht);
 			return NULL;
 		}
 
-		if (!_cds_lfht_replace(ht, size, iter.node, iter.next, node))
+		if (!_cds_lfht_replace(ht, size, iter.node, iter.next, node)) {
+			cds_lfht_resize_help(ht);
 			return iter.node;
+		}
 	}
 }
 
@@ -1676,6 +2393,7 @@ int cds_lfht_del(struct cds_lfht *ht, struct cds_lfht_node *node)
 		hash = bit_reverse_ulong(node->reverse_hash);
 		ht_count_del(ht, size, hash);
 	}
+	cds_lfht_resize_help(ht);
 	return ret;
 }
 
@@ -1684,13 +2402,16 @@ int cds_lfht_is_node_deleted(struct cds_lfht_node *node)
 	return is_removed(CMM_LOAD_SHARED(node->next));
 }
 
+/*
+ * Return -EPERM if the table contains any node, 0 otherwise. Must be
+ * called with the resize mutex held, or when the table can no longer
+ * be resized.
+ */
 static
-int cds_lfht_delete_bucket(struct cds_lfht *ht)
+int cds_lfht_check_empty(struct cds_lfht *ht)
 {
 	struct cds_lfht_node *node;
-	unsigned long order, i, size;
 
-	/* Check that the table is empty */
 	node = bucket_at(ht, 0);
 	do {
 		node = clear_flag(node)->next;
@@ -1698,6 +2419,20 @@ int cds_lfht_delete_bucket(struct cds_lfht *ht)
 			return -EPERM;
 		assert(!is_removed(node));
 	} while (!is_end(node));
+	return 0;
+}
+
+static
+int cds_lfht_delete_bucket(struct cds_lfht *ht)
+{
+	struct cds_lfht_node *node;
+	unsigned long order, i, size;
+	int ret;
+
+	/* Check that the table is empty */
+	ret = cds_lfht_check_empty(ht);
+	if (ret)
+		return ret;
 	/*
 	 * size accessed without rcu_dereference because hash table is
 	 * being destroyed.
@@ -1736,6 +2471,8 @@ int cds_lfht_destroy(struct cds_lfht *ht, pthread_attr_t **attr)
 	if (ret)
 		return ret;
 	free_split_items_count(ht);
+	if (ht->resize_pool)
+		resize_pool_put(ht->resize_pool);
 	if (attr)
 		*attr = ht->resize_attr;
 	poison_free(ht);
@@ -1840,10 +2577,18 @@ void _do_cds_lfht_resize(struct cds_lfht *ht)
 		ht->resize_initiated = 1;
 		old_size = ht->size;
 		new_size = CMM_LOAD_SHARED(ht->resize_target);
+		if (ht->flags & CDS_LFHT_BUCKET_TAGS) {
+			CMM_STORE_SHARED(ht->tags_seq, ht->tags_seq + 1);
+			cmm_smp_mb();	/* write tags_seq before size */
+		}
 		if (old_size < new_size)
 			_do_cds_lfht_grow(ht, old_size, new_size);
 		else if (old_size > new_size)
 			_do_cds_lfht_shrink(ht, old_size, new_size);
+		if (ht->flags & CDS_LFHT_BUCKET_TAGS) {
+			cmm_smp_mb();	/* write tags before tags_seq */
+			CMM_STORE_SHARED(ht->tags_seq, ht->tags_seq + 1);
+		}
 		ht->resize_initiated = 0;
 		/* write resize_initiated before read resize_target */
 		cmm_smp_mb();
@@ -1865,6 +2610,152 @@ void resize_target_update_count(struct cds_lfht *ht,
 	uatomic_set(&ht->resize_target, count);
 }
 
+/* Position in split order of the bucket of a node, for 2^order buckets. */
+static inline
+unsigned long bulk_load_pos(unsigned long reverse_hash, unsigned long order)
+{
+	return order ? reverse_hash >> (CAA_BITS_PER_LONG - order) : 0;
+}
+
+/* Index of the first node at or after bucket position "pos". */
+static
+unsigned long bulk_load_lower_bound(struct cds_lfht_node **nodes,
+		unsigned long nr_nodes, unsigned long order, unsigned long pos)
+{
+	unsigned long low = 0, high = nr_nodes;
+
+	while (low < high) {
+		unsigned long mid = low + ((high - low) >> 1);
+
+		if (bulk_load_pos(nodes[mid]->reverse_hash, order) < pos)
+			low = mid + 1;
+		else
+			high = mid;
+	}
+	return low;
+}
+
+/*
+ * Link the sorted nodes of the buckets at positions start to
+ * start + len - 1 in split order, of a table of 2^i buckets. The table
+ * being otherwise empty, each bucket node is followed by the next
+ * bucket node: the nodes of a bucket are chained before publishing
+ * them in one store.
+ */
+static
+void bulk_load_partition(struct cds_lfht *ht, unsigned long i,
+			 unsigned long start, unsigned long len)
+{
+	struct cds_lfht_node **nodes = ht->bulk_nodes;
+	unsigned long nr_nodes = ht->nr_bulk_nodes;
+	unsigned long pos, k;
+
+	k = bulk_load_lower_bound(nodes, nr_nodes, i, start);
+	for (pos = start; pos < start + len; pos++) {
+		struct cds_lfht_node *bucket, *next;
+		unsigned long index, first = k, tags = 0;
+
+		while (k < nr_nodes
+		       && bulk_load_pos(nodes[k]->reverse_hash, i) == pos) {
+			if (k > first)
+				nodes[k - 1]->next = nodes[k];
+			tags |= hash_tag(nodes[k]->reverse_hash);
+			k++;
+		}
+		if (k == first)
+			continue;
+		index = i ? bit_reverse_ulong(pos) >> (CAA_BITS_PER_LONG - i) : 0;
+		bucket = bucket_at(ht, index);
+		next = CMM_LOAD_SHARED(bucket->next);
+		assert(is_bucket(next));
+		assert(is_end(clear_flag(next))
+		       || is_bucket(clear_flag(next)->next));
+		nodes[k - 1]->next = clear_flag(next);
+		if (ht->flags & CDS_LFHT_BUCKET_TAGS)
+			uatomic_or(tags_at(ht, index), tags);
+		rcu_assign_pointer(bucket->next, flag_bucket(nodes[first]));
+	}
+}
+
+static
+void bulk_load_populate(struct cds_lfht *ht, unsigned long order)
+{
+	unsigned long size = 1UL << order;
+
+	assert(nr_cpus_mask != -1);
+	if (nr_cpus_mask < 0 || size < 2 * MIN_PARTITION_PER_THREAD) {
+		bulk_load_partition(ht, order, 0, size);
+		return;
+	}
+	partition_resize_helper(ht, order, size, bulk_load_partition);
+}
+
+static
+int bulk_load_cmp(const void *a, const void *b)
+{
+	const struct cds_lfht_node *node_a = *(struct cds_lfht_node * const *) a;
+	const struct cds_lfht_node *node_b = *(struct cds_lfht_node * const *) b;
+
+	if (node_a->reverse_hash < node_b->reverse_hash)
+		return -1;
+	return node_a->reverse_hash > node_b->reverse_hash;
+}
+
+int cds_lfht_bulk_load(struct cds_lfht *ht, struct cds_lfht_node **nodes,
+		const unsigned long *hashes, unsigned long nr_nodes)
+{
+	unsigned long k, target_size;
+	int sorted = 1, ret;
+
+	for (k = 0; k < nr_nodes; k++) {
+		nodes[k]->reverse_hash = bit_reverse_ulong(hashes[k]);
+		if (k && nodes[k]->reverse_hash < nodes[k - 1]->reverse_hash)
+			sorted = 0;
+	}
+	if (!sorted)
+		qsort(nodes, nr_nodes, sizeof(*nodes), bulk_load_cmp);
+
+	target_size = max(nr_nodes >> (CHAIN_LEN_TARGET - 1), MIN_TABLE_SIZE);
+	target_size = 1UL << cds_lfht_get_count_order_ulong(target_size);
+	target_size = min(target_size, ht->max_nr_buckets);
+
+	uatomic_inc(&ht->in_progress_resize);
+	ht->flavor->thread_offline();
+	pthread_mutex_lock(&ht->resize_mutex);
+	/*
+	 * Bucket chains are overwritten below: nodes already in the table
+	 * would be unlinked and leaked.
+	 */
+	ret = cds_lfht_check_empty(ht);
+	if (ret)
+		goto end;
+	resize_target_grow(ht, target_size);
+	CMM_STORE_SHARED(ht->resize_initiated, 1);
+	_do_cds_lfht_resize(ht);
+	ht->bulk_nodes = nodes;
+	ht->nr_bulk_nodes = nr_nodes;
+	bulk_load_populate(ht, cds_lfht_get_count_order_ulong(ht->size));
+	ht->bulk_nodes = NULL;
+end:
+	pthread_mutex_unlock(&ht->resize_mutex);
+	ht->flavor->thread_online();
+	cmm_smp_mb();	/* finish bulk load before decrement */
+	uatomic_dec(&ht->in_progress_resize);
+
+	if (!ret && ht->split_count && nr_nodes) {
+		unsigned long split_count;
+
+		/* Commit to the global count as nr_nodes ht_count_add would */
+		split_count = uatomic_add_return(&ht->split_count[0].add,
+				nr_nodes);
+		uatomic_add(&ht->count,
+			((split_count >> COUNT_COMMIT_ORDER)
+			 - ((split_count - nr_nodes) >> COUNT_COMMIT_ORDER))
+			<< COUNT_COMMIT_ORDER);
+	}
+	return ret;
+}
+
 void cds_lfht_resize(struct cds_lfht *ht, unsigned long new_size)
 {
 	resize_target_update_count(ht, new_size);
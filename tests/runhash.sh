@@ -119,6 +119,67 @@ ${TESTPROG} $((2*${THREAD_MUL})) $((2*${THREAD_MUL})) ${TIME_UNITS} -A \
 ${TESTPROG} $((2*${THREAD_MUL})) $((2*${THREAD_MUL})) ${TIME_UNITS} -A \
 	-M 10 -N 10 -O 10 -R 0 -T 0 -S 10 -k 10 -s ${EXTRA_PARAMS}
 
+# ** batched lookups
+
+# rw test, 2 lookup, 2 update threads, add_unique and del randomly, auto resize.
+# max 1048576 buckets
+# lookup range is entirely populated.
+# key range: init, and lookups: 0 to 99
+# key range: updates: 100 to 199
+# lookups by batches of 16 keys, validated against single lookups.
+${TESTPROG} $((2*${THREAD_MUL})) $((2*${THREAD_MUL})) ${TIME_UNITS} -A \
+	-M 100 -N 100 -O 100 -R 0 -T 0 -S 100 -k 100 -u -b 16 -V ${EXTRA_PARAMS}
+
+# ** bucket tags
+
+# rw test, 2 lookup, 2 update threads, add_unique and del randomly, auto resize.
+# max 1048576 buckets
+# lookup range is entirely populated.
+# key range: init, and lookups: 0 to 99
+# key range: updates: 100 to 199
+# bucket tags, single and batched lookups.
+${TESTPROG} $((2*${THREAD_MUL})) $((2*${THREAD_MUL})) ${TIME_UNITS} -A \
+	-M 100 -N 100 -O 100 -R 0 -T 0 -S 100 -k 100 -u -t -V ${EXTRA_PARAMS}
+${TESTPROG} $((2*${THREAD_MUL})) $((2*${THREAD_MUL})) ${TIME_UNITS} -A \
+	-M 100 -N 100 -O 100 -R 0 -T 0 -S 100 -k 100 -u -t -b 16 -V ${EXTRA_PARAMS}
+
+# ** bulk load
+
+# rw test, 2 lookup, 2 update threads, add_unique and del randomly, auto resize.
+# max 1048576 buckets
+# lookup range is entirely populated by bulk load.
+# key range: init, and lookups: 0 to 99
+# key range: updates: 100 to 199
+${TESTPROG} $((2*${THREAD_MUL})) $((2*${THREAD_MUL})) ${TIME_UNITS} -A \
+	-M 100 -N 100 -O 100 -R 0 -T 0 -S 100 -k 100 -u -L -V ${EXTRA_PARAMS}
+${TESTPROG} $((2*${THREAD_MUL})) $((2*${THREAD_MUL})) ${TIME_UNITS} -A \
+	-M 100 -N 100 -O 100 -R 0 -T 0 -S 100 -k 100 -u -L -t -V ${EXTRA_PARAMS}
+
+# ** resize worker threads
+
+# rw test, 2 lookup, 2 update threads, add and del randomly, auto resize.
+# max 1048576 buckets
+# 3 resize worker threads, resizes partitioned from 8192 buckets.
+${TESTPROG} $((2*${THREAD_MUL})) $((2*${THREAD_MUL})) ${TIME_UNITS} -A \
+	-W 3 ${EXTRA_PARAMS}
+# Min. 1048576 buckets bulk loaded, validated lookups.
+${TESTPROG} $((2*${THREAD_MUL})) 0 ${TIME_UNITS} \
+	-M 1000000 -O 1000000 -R 0 -T 0 -k 1000000 -L -V -W 3 ${EXTRA_PARAMS}
+
+# ** incremental resize
+
+# rw test, 2 lookup, 2 update threads, add and del randomly, auto resize.
+# max 1048576 buckets
+# resize by slices of 64 buckets.
+${TESTPROG} $((2*${THREAD_MUL})) $((2*${THREAD_MUL})) ${TIME_UNITS} -A \
+	-I 64 ${EXTRA_PARAMS}
+# lookup range is entirely populated, validated lookups.
+${TESTPROG} $((2*${THREAD_MUL})) $((2*${THREAD_MUL})) ${TIME_UNITS} -A \
+	-M 100 -N 100 -O 100 -R 0 -T 0 -S 100 -k 100 -u -I 64 -t -V ${EXTRA_PARAMS}
+# Min. 1048576 buckets bulk loaded, validated lookups.
+${TESTPROG} $((2*${THREAD_MUL})) 0 ${TIME_UNITS} \
+	-M 1000000 -O 1000000 -R 0 -T 0 -k 1000000 -L -V -I 4096 ${EXTRA_PARAMS}
+
 # ** Uniqueness test
 
 # rw test, 2 lookup, 2 update threads, add_unique, add_replace and del randomly, auto resize.
@@ -33,6 +33,7 @@
 #include <assert.h>
 #include <sched.h>
 #include <errno.h>
+#include <poll.h>
 
 #include <urcu/arch.h>
 #include <urcu/tls-compat.h>
@@ -66,6 +67,11 @@ static inline pid_t gettid(void)
 #endif
 #include <urcu.h>
 
+/* call_rcu tests: batching delay long enough to never elapse */
+#define CALL_RCU_TEST_DELAY_US	10000000
+#define CALL_RCU_TEST_QLEN	8
+#define CALL_RCU_TEST_TIMEOUT	5000	/* ms */
+
 struct test_array {
 	int a;
 };
@@ -74,6 +80,14 @@ static volatile int test_go, test_stop;
 
 static unsigned long wdelay;
 
+static int expedited;
+
+/* grace period stall timeout, in ms */
+static unsigned int stall_timeout;
+static unsigned long nr_stall_reports;
+
+static int dump_trace;
+
 static struct test_array *test_rcu_pointer;
 
 static unsigned long duration;
@@ -283,7 +297,10 @@ void *thr_writer(void *_count)
 		old = rcu_xchg_pointer(&test_rcu_pointer, new);
 		if (caa_unlikely(wduration))
 			loop_sleep(wduration);
-		synchronize_rcu();
+		if (expedited)
+			synchronize_rcu_expedited();
+		else
+			synchronize_rcu();
 		if (old)
 			old->a = 0;
 		test_array_free(old);
@@ -301,6 +318,326 @@ void *thr_writer(void *_count)
 	return ((void*)2);
 }
 
+/* Called serialized by the library */
+static void count_stall(const struct rcu_stall_reader *reader, void *priv)
+{
+	nr_stall_reports++;
+	printf_verbose("stalled reader %s, thread id : %lx, nesting %lu, "
+		"%llu ms\n", reader->flavor, (unsigned long) reader->tid,
+		reader->nesting,
+		(unsigned long long) reader->stall_ns / 1000000ULL);
+}
+
+/*
+ * Check the grace period latency histogram accounts for each grace
+ * period. Returns nonzero on mismatch.
+ */
+static int check_stats(void)
+{
+	struct rcu_stats stats;
+	unsigned long long nr = 0;
+	unsigned int i;
+
+	rcu_get_stats(&stats);
+	for (i = 0; i < RCU_STATS_LATENCY_BUCKETS; i++)
+		nr += stats.gp_latency_hist[i];
+	printf_verbose("grace periods : %llu, expedited %llu, "
+		"readers scanned %llu, sleeps %llu, "
+		"latency avg %llu ns max %llu ns\n",
+		stats.gp_count, stats.gp_expedited,
+		stats.gp_readers_scanned, stats.gp_sleeps,
+		stats.gp_count ?
+			stats.gp_latency_total_ns / stats.gp_count : 0,
+		stats.gp_latency_max_ns);
+	return nr != stats.gp_count;
+}
+
+static struct rcu_head test_heads[CALL_RCU_TEST_QLEN + 1];
+static unsigned long nr_test_callbacks;
+static int test_gate_open;
+static int test_call_rcu_returned;
+static pthread_t test_callback_thread;
+
+static void test_callback(struct rcu_head *head)
+{
+	uatomic_inc(&nr_test_callbacks);
+}
+
+/* Record the call_rcu thread invoking the callback. */
+static void test_thread_callback(struct rcu_head *head)
+{
+	test_callback_thread = pthread_self();
+	cmm_smp_wmb();	/* Write thread before count. */
+	uatomic_inc(&nr_test_callbacks);
+}
+
+/* Keep the call_rcu thread within its batch until the gate opens. */
+static void test_gate_callback(struct rcu_head *head)
+{
+	while (!uatomic_read(&test_gate_open))
+		poll(NULL, 0, 1);
+	uatomic_inc(&nr_test_callbacks);
+}
+
+/*
+ * Sleep by periods of 1 ms: grace periods of the signal flavor
+ * interrupt poll() in registered threads.
+ */
+static void test_msleep(unsigned int ms)
+{
+	while (ms--)
+		poll(NULL, 0, 1);
+}
+
+/*
+ * Wait up to CALL_RCU_TEST_TIMEOUT ms for "nr" test callbacks to be
+ * invoked. Returns nonzero on timeout.
+ */
+static int wait_test_callbacks(unsigned long nr)
+{
+	unsigned int timeout = CALL_RCU_TEST_TIMEOUT;
+
+	while (uatomic_read(&nr_test_callbacks) < nr) {
+		if (!timeout--)
+			return 1;
+		poll(NULL, 0, 1);
+	}
+	return 0;
+}
+
+/*
+ * Create a call_rcu_data used by this thread, and wait for its call_rcu
+ * thread to be idle: callbacks queued before the call_rcu thread first
+ * waits are invoked right away. Returns NULL on failure.
+ */
+static struct call_rcu_data *create_test_call_rcu_data(void)
+{
+	struct call_rcu_data *crdp;
+	unsigned int timeout = CALL_RCU_TEST_TIMEOUT;
+
+	crdp = create_call_rcu_data(0, -1);
+	set_thread_call_rcu_data(crdp);
+	uatomic_set(&nr_test_callbacks, 0);
+	call_rcu(&test_heads[0], test_callback);
+	if (wait_test_callbacks(1))
+		goto error;
+	while (get_call_rcu_data_qlen(crdp)) {
+		if (!timeout--)
+			goto error;
+		poll(NULL, 0, 1);
+	}
+	uatomic_set(&nr_test_callbacks, 0);
+	return crdp;
+
+error:
+	fprintf(stderr, "call_rcu callback not invoked\n");
+	set_thread_call_rcu_data(NULL);
+	synchronize_rcu();
+	call_rcu_data_free(crdp);
+	return NULL;
+}
+
+static void free_test_call_rcu_data(struct call_rcu_data *crdp)
+{
+	set_thread_call_rcu_data(NULL);
+	synchronize_rcu();
+	call_rcu_data_free(crdp);
+}
+
+/*
+ * Check the call_rcu thread lets callbacks accumulate for its batching
+ * delay, that reaching the queue length threshold wakes it up early,
+ * and that it then invokes the whole batch after a single grace period.
+ * Returns nonzero on failure.
+ */
+static int check_call_rcu_batching(void)
+{
+	struct call_rcu_data *crdp;
+	struct rcu_stats before, after;
+	int i, ret = 0;
+
+	crdp = create_test_call_rcu_data();
+	if (!crdp)
+		return 1;
+	set_call_rcu_data_batching(crdp, CALL_RCU_TEST_DELAY_US,
+		CALL_RCU_TEST_QLEN);
+	rcu_get_stats(&before);
+
+	call_rcu(&test_heads[0], test_callback);
+	test_msleep(100);
+	if (uatomic_read(&nr_test_callbacks)) {
+		fprintf(stderr, "call_rcu callback invoked within the "
+			"batching delay\n");
+		ret = 1;
+	}
+	for (i = 1; i < CALL_RCU_TEST_QLEN; i++)
+		call_rcu(&test_heads[i], test_callback);
+	if (wait_test_callbacks(CALL_RCU_TEST_QLEN)) {
+		fprintf(stderr, "call_rcu queue length threshold did not "
+			"wake up the call_rcu thread\n");
+		ret = 1;
+	}
+	rcu_get_stats(&after);
+	if (!ret && after.gp_count - before.gp_count != 1) {
+		fprintf(stderr, "call_rcu batch took %llu grace periods\n",
+			after.gp_count - before.gp_count);
+		ret = 1;
+	}
+	free_test_call_rcu_data(crdp);
+	return ret;
+}
+
+static void *thr_call_rcu_block(void *arg)
+{
+	struct call_rcu_data *crdp = arg;
+
+	rcu_register_thread();
+	set_thread_call_rcu_data(crdp);
+	call_rcu(&test_heads[CALL_RCU_TEST_QLEN], test_callback);
+	uatomic_set(&test_call_rcu_returned, 1);
+	set_thread_call_rcu_data(NULL);
+	rcu_unregister_thread();
+	return NULL;
+}
+
+/*
+ * Fill the queue up to its high watermark behind a callback keeping the
+ * call_rcu thread busy, and check that one more call_rcu() is queued
+ * (expedite), invoked inline (help), or blocked until the batch
+ * completes (block). Returns nonzero on failure.
+ */
+static int check_call_rcu_backpressure(int policy)
+{
+	struct call_rcu_data *crdp;
+	struct call_rcu_backpressure_stats stats;
+	pthread_t tid;
+	void *tret;
+	int i, ret = 0;
+
+	crdp = create_test_call_rcu_data();
+	if (!crdp)
+		return 1;
+	set_call_rcu_data_batching(crdp, CALL_RCU_TEST_DELAY_US, 0);
+	set_call_rcu_data_backpressure(crdp, CALL_RCU_TEST_QLEN, policy);
+	uatomic_set(&test_gate_open, 0);
+	uatomic_set(&test_call_rcu_returned, 0);
+	call_rcu(&test_heads[0], test_gate_callback);
+	for (i = 1; i < CALL_RCU_TEST_QLEN; i++)
+		call_rcu(&test_heads[i], test_callback);
+
+	switch (policy) {
+	case URCU_CALL_RCU_BACKPRESSURE_EXPEDITE:
+		call_rcu(&test_heads[CALL_RCU_TEST_QLEN], test_callback);
+		get_call_rcu_data_backpressure_stats(crdp, &stats);
+		if (stats.expedite != 1 || uatomic_read(&nr_test_callbacks)) {
+			fprintf(stderr, "call_rcu expedite backpressure "
+				"not applied\n");
+			ret = 1;
+		}
+		break;
+	case URCU_CALL_RCU_BACKPRESSURE_HELP:
+		call_rcu(&test_heads[CALL_RCU_TEST_QLEN], test_callback);
+		get_call_rcu_data_backpressure_stats(crdp, &stats);
+		if (stats.help != 1 || uatomic_read(&nr_test_callbacks) != 1) {
+			fprintf(stderr, "call_rcu help backpressure did not "
+				"invoke the callback inline\n");
+			ret = 1;
+		}
+		break;
+	case URCU_CALL_RCU_BACKPRESSURE_BLOCK:
+		if (pthread_create(&tid, NULL, thr_call_rcu_block, crdp))
+			exit(1);
+		test_msleep(100);
+		get_call_rcu_data_backpressure_stats(crdp, &stats);
+		if (stats.block != 1 || uatomic_read(&test_call_rcu_returned)) {
+			fprintf(stderr, "call_rcu block backpressure did not "
+				"block the caller\n");
+			ret = 1;
+		}
+		break;
+	}
+
+	/* Flush the queue as soon as the batch in progress completes. */
+	set_call_rcu_data_batching(crdp, 0, 0);
+	uatomic_set(&test_gate_open, 1);
+	if (policy == URCU_CALL_RCU_BACKPRESSURE_BLOCK
+			&& pthread_join(tid, &tret))
+		exit(1);
+	if (wait_test_callbacks(CALL_RCU_TEST_QLEN + 1)) {
+		fprintf(stderr, "call_rcu callbacks not invoked after "
+			"backpressure\n");
+		ret = 1;
+	}
+	free_test_call_rcu_data(crdp);
+	return ret;
+}
+
+#if defined(HAVE_SCHED_GETCPU) && HAVE_SCHED_SETAFFINITY
+/*
+ * Check that create_all_node_call_rcu_data() creates a worker for the
+ * node of our CPU, and that call_rcu() queues our callbacks there
+ * rather than on the default worker. Returns nonzero on failure.
+ */
+static int check_call_rcu_node(void)
+{
+	struct call_rcu_data *crdp;
+	cpu_set_t mask;
+	int cpu, node, ret = 0;
+
+	if (create_all_node_call_rcu_data(0)) {
+		printf_verbose("no call_rcu node workers: %s\n",
+			strerror(errno));
+		return 0;
+	}
+	cpu = sched_getcpu();
+	if (cpu < 0 || cpu >= CPU_SETSIZE)
+		goto end;
+	/* Stay on the node of our CPU. */
+	CPU_ZERO(&mask);
+	CPU_SET(cpu, &mask);
+#if SCHED_SETAFFINITY_ARGS == 2
+	sched_setaffinity(0, &mask);
+#else
+	sched_setaffinity(0, sizeof(mask), &mask);
+#endif
+
+	rcu_read_lock();
+	crdp = get_call_rcu_data();
+	rcu_read_unlock();
+	for (node = 0; node < NR_CPUS; node++) {
+		if (get_node_call_rcu_data(node) == crdp)
+			break;
+	}
+	if (node == NR_CPUS) {
+		fprintf(stderr, "call_rcu did not pick the node worker "
+			"of CPU %d\n", cpu);
+		ret = 1;
+		goto end;
+	}
+	uatomic_set(&nr_test_callbacks, 0);
+	call_rcu(&test_heads[0], test_thread_callback);
+	if (wait_test_callbacks(1)) {
+		fprintf(stderr, "call_rcu callback not invoked\n");
+		ret = 1;
+		goto end;
+	}
+	cmm_smp_rmb();	/* Read count before thread. */
+	if (!pthread_equal(test_callback_thread, get_call_rcu_thread(crdp))) {
+		fprintf(stderr, "call_rcu callback not invoked by the worker "
+			"of node %d\n", node);
+		ret = 1;
+	}
+end:
+	free_all_node_call_rcu_data();
+	return ret;
+}
+#else
+static int check_call_rcu_node(void)
+{
+	return 0;
+}
+#endif
+
 void show_usage(int argc, char **argv)
 {
 	printf("Usage : %s nr_readers nr_writers duration (s)", argv[0]);
@@ -310,6 +647,9 @@ void show_usage(int argc, char **argv)
 	printf(" [-d delay] (writer period (us))");
 	printf(" [-c duration] (reader C.S. duration (in loops))");
 	printf(" [-e duration] (writer C.S. duration (in loops))");
+	printf(" [-x] (expedited grace periods)");
+	printf(" [-s timeout] (grace period stall timeout (ms))");
+	printf(" [-t] (dump grace period trace)");
 	printf(" [-v] (verbose output)");
 	printf(" [-a cpu#] [-a cpu#]... (affinity)");
 	printf("\n");
@@ -390,6 +730,19 @@ int main(int argc, char **argv)
 			}
 			wduration = atol(argv[++i]);
 			break;
+		case 'x':
+			expedited = 1;
+			break;
+		case 's':
+			if (argc < i + 2) {
+				show_usage(argc, argv);
+				return -1;
+			}
+			stall_timeout = atol(argv[++i]);
+			break;
+		case 't':
+			dump_trace = 1;
+			break;
 		case 'v':
 			verbose_mode = 1;
 			break;
@@ -403,6 +756,9 @@ int main(int argc, char **argv)
 	printf_verbose("thread %-6s, thread id : %lx, tid %lu\n",
 			"main", pthread_self(), (unsigned long)gettid());
 
+	if (stall_timeout)
+		rcu_set_stall_timeout(stall_timeout, count_stall, NULL);
+
 	test_array = calloc(1, sizeof(*test_array) * ARRAY_SIZE);
 	tid_reader = malloc(sizeof(*tid_reader) * nr_readers);
 	tid_writer = malloc(sizeof(*tid_writer) * nr_writers);
@@ -447,6 +803,24 @@ int main(int argc, char **argv)
 	
 	printf_verbose("total number of reads : %llu, writes %llu\n", tot_reads,
 	       tot_writes);
+	if (stall_timeout)
+		printf_verbose("stalled readers reported : %lu\n",
+			nr_stall_reports);
+	if (dump_trace)
+		rcu_trace_dump(stdout);
+	if (check_stats()) {
+		fprintf(stderr, "grace period statistics mismatch\n");
+		exit(1);
+	}
+	rcu_register_thread();
+	err = check_call_rcu_batching();
+	err |= check_call_rcu_backpressure(URCU_CALL_RCU_BACKPRESSURE_EXPEDITE);
+	err |= check_call_rcu_backpressure(URCU_CALL_RCU_BACKPRESSURE_HELP);
+	err |= check_call_rcu_backpressure(URCU_CALL_RCU_BACKPRESSURE_BLOCK);
+	err |= check_call_rcu_node();
+	rcu_unregister_thread();
+	if (err)
+		exit(1);
 	printf("SUMMARY %-25s testdur %4lu nr_readers %3u rdur %6lu wdur %6lu "
 		"nr_writers %3u "
 		"wdelay %6lu nr_reads %12llu nr_writes %12llu nr_ops %12llu\n",
@@ -74,6 +74,8 @@ static volatile int test_go, test_stop;
 
 static unsigned long wdelay;
 
+static int expedited;
+
 static struct test_array *test_rcu_pointer;
 
 static unsigned long duration;
@@ -279,7 +281,10 @@ void *thr_writer(void *_count)
 		old = rcu_xchg_pointer(&test_rcu_pointer, new);
 		if (caa_unlikely(wduration))
 			loop_sleep(wduration);
-		synchronize_rcu();
+		if (expedited)
+			synchronize_rcu_expedited();
+		else
+			synchronize_rcu();
 		if (old)
 			old->a = 0;
 		test_array_free(old);
@@ -306,6 +311,7 @@ void show_usage(int argc, char **argv)
 	printf(" [-d delay] (writer period (us))");
 	printf(" [-c duration] (reader C.S. duration (in loops))");
 	printf(" [-e duration] (writer C.S. duration (in loops))");
+	printf(" [-x] (expedited grace periods)");
 	printf(" [-v] (verbose output)");
 	printf(" [-a cpu#] [-a cpu#]... (affinity)");
 	printf("\n");
@@ -386,6 +392,9 @@ int main(int argc, char **argv)
 			}
 			wduration = atol(argv[++i]);
 			break;
+		case 'x':
+			expedited = 1;
+			break;
 		case 'v':
 			verbose_mode = 1;
 			break;
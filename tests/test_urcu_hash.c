@@ -106,6 +106,9 @@ unsigned long min_hash_alloc_size = DEFAULT_MIN_ALLOC_SIZE;
 unsigned long max_hash_buckets_size = (1UL << 20);
 unsigned long init_populate;
 int opt_auto_resize;
+int opt_bucket_tags;
+int opt_bulk_load;
+unsigned long opt_resize_slice;	/* 0: resize by orders */
 int add_only, add_unique, add_replace;
 const struct cds_lfht_mm_type *memory_backend;
 
@@ -115,6 +118,7 @@ unsigned long init_pool_size = DEFAULT_RAND_POOL,
 	write_pool_size = DEFAULT_RAND_POOL;
 int validate_lookup;
 unsigned long nr_hash_chains;	/* 0: normal table, other: number of hash chains */
+unsigned long lookup_batch;	/* 0: single lookups, other: keys per batch */
 
 int count_pipe[2];
 
@@ -292,6 +296,11 @@ printf("        [not -u nor -s] Add entries (supports redundant keys).\n");
 	printf("        [-V] Validate lookups of init values (use with filled init pool, same lookup range, with different write range).\n");
 	printf("	[-U] Uniqueness test.\n");
 	printf("	[-C] Number of hash chains.\n");
+	printf("	[-b nr_keys] Lookup batches of nr_keys keys.\n");
+	printf("	[-t] Bucket tags.\n");
+	printf("	[-L] Bulk load initial nodes (distinct keys).\n");
+	printf("	[-W nr_workers] Number of resize worker threads.\n");
+	printf("	[-I nr_buckets] Incremental resize by slices of nr_buckets.\n");
 	printf("\n\n");
 }
 
@@ -461,6 +470,33 @@ int main(int argc, char **argv)
 		case 'C':
 			nr_hash_chains = atol(argv[++i]);
 			break;
+		case 'b':
+			if (argc < i + 2) {
+				show_usage(argc, argv);
+				return -1;
+			}
+			lookup_batch = atol(argv[++i]);
+			break;
+		case 't':
+			opt_bucket_tags = 1;
+			break;
+		case 'L':
+			opt_bulk_load = 1;
+			break;
+		case 'W':
+			if (argc < i + 2) {
+				show_usage(argc, argv);
+				return -1;
+			}
+			cds_lfht_set_resize_workers(atol(argv[++i]));
+			break;
+		case 'I':
+			if (argc < i + 2) {
+				show_usage(argc, argv);
+				return -1;
+			}
+			opt_resize_slice = atol(argv[++i]);
+			break;
 		}
 	}
 
@@ -552,18 +588,27 @@ int main(int argc, char **argv)
 		test_ht = _cds_lfht_new(init_hash_size, min_hash_alloc_size,
 				max_hash_buckets_size,
 				(opt_auto_resize ? CDS_LFHT_AUTO_RESIZE : 0) |
+				(opt_bucket_tags ? CDS_LFHT_BUCKET_TAGS : 0) |
+				(opt_resize_slice ? CDS_LFHT_INCREMENTAL_RESIZE : 0) |
 				CDS_LFHT_ACCOUNTING, memory_backend,
 				&rcu_flavor, NULL);
 	} else {
 		test_ht = cds_lfht_new(init_hash_size, min_hash_alloc_size,
 				max_hash_buckets_size,
 				(opt_auto_resize ? CDS_LFHT_AUTO_RESIZE : 0) |
+				(opt_bucket_tags ? CDS_LFHT_BUCKET_TAGS : 0) |
+				(opt_resize_slice ? CDS_LFHT_INCREMENTAL_RESIZE : 0) |
 				CDS_LFHT_ACCOUNTING, NULL);
 	}
 	if (!test_ht) {
 		printf("Error allocating hash table.\n");
 		return -1;
 	}
+	if (opt_resize_slice
+	    && cds_lfht_set_resize_slice(test_ht, opt_resize_slice, 0)) {
+		printf("Error setting resize slices.\n");
+		return -1;
+	}
 
 	/*
 	 * Hash Population needs to be seen as a RCU reader
@@ -662,6 +707,8 @@ int main(int argc, char **argv)
 		printf_verbose("final delete aborted\n");
 	else
 		printf_verbose("final delete success\n");
+	/* Wait for the node reclamation callbacks to complete. */
+	rcu_barrier();
 	printf_verbose("total number of reads : %llu, writes %llu\n", tot_reads,
 	       tot_writes);
 	printf("SUMMARY %-25s testdur %4lu nr_readers %3u rdur %6lu "
@@ -162,6 +162,9 @@ extern unsigned long min_hash_alloc_size;
 extern unsigned long max_hash_buckets_size;
 extern unsigned long init_populate;
 extern int opt_auto_resize;
+extern int opt_bucket_tags;
+extern int opt_bulk_load;
+extern unsigned long opt_resize_slice;
 extern int add_only, add_unique, add_replace;
 extern const struct cds_lfht_mm_type *memory_backend;
 
@@ -172,6 +175,7 @@ extern unsigned long init_pool_size,
 extern int validate_lookup;
 
 extern unsigned long nr_hash_chains;
+extern unsigned long lookup_batch;
 
 extern int count_pipe[2];
 
@@ -59,17 +59,66 @@ void test_hash_rw_sigusr2_handler(int signo)
 	} while (ret == -1L && errno == EINTR);
 }
 
+/*
+ * Lookup a batch of random keys. When validating, each result must
+ * match the one of a single lookup.
+ */
+static void test_hash_rw_lookup_batch(struct cds_lfht_lookup_key *keys,
+		struct cds_lfht_iter *iters)
+{
+	struct cds_lfht_iter iter;
+	unsigned long i;
+
+	for (i = 0; i < lookup_batch; i++) {
+		keys[i].key = (void *)(((unsigned long) rand_r(&URCU_TLS(rand_lookup)) % lookup_pool_size) + lookup_pool_offset);
+		keys[i].hash = test_hash(keys[i].key, sizeof(void *),
+				TEST_HASH_SEED);
+	}
+	cds_lfht_lookup_batch(test_ht, test_match, keys, lookup_batch, iters);
+	for (i = 0; i < lookup_batch; i++) {
+		if (cds_lfht_iter_get_node(&iters[i]) == NULL) {
+			if (validate_lookup) {
+				printf("[ERROR] Lookup cannot find initial node.\n");
+				exit(-1);
+			}
+			URCU_TLS(lookup_fail)++;
+		} else {
+			URCU_TLS(lookup_ok)++;
+		}
+		if (validate_lookup) {
+			cds_lfht_test_lookup(test_ht, (void *) keys[i].key,
+				sizeof(void *), &iter);
+			if (cds_lfht_iter_get_node(&iter)
+			    != cds_lfht_iter_get_node(&iters[i])) {
+				printf("[ERROR] Batch lookup differs from lookup.\n");
+				exit(-1);
+			}
+		}
+	}
+}
+
 void *test_hash_rw_thr_reader(void *_count)
 {
 	unsigned long long *count = _count;
 	struct lfht_test_node *node;
 	struct cds_lfht_iter iter;
+	struct cds_lfht_lookup_key *batch_keys = NULL;
+	struct cds_lfht_iter *batch_iters = NULL;
 
 	printf_verbose("thread_begin %s, thread id : %lx, tid %lu\n",
 			"reader", pthread_self(), (unsigned long)gettid());
 
 	set_affinity();
 
+	if (lookup_batch) {
+		batch_keys = calloc(lookup_batch, sizeof(*batch_keys));
+		batch_iters = calloc(lookup_batch, sizeof(*batch_iters));
+		if (!batch_keys || !batch_iters) {
+			perror("calloc");
+			exit(-1);
+		}
+	}
+
 	rcu_register_thread();
 
 	while (!test_go)
@@ -79,18 +128,22 @@ void *test_hash_rw_thr_reader(void *_count)
 
 	for (;;) {
 		rcu_read_lock();
-		cds_lfht_test_lookup(test_ht,
-			(void *)(((unsigned long) rand_r(&URCU_TLS(rand_lookup)) % lookup_pool_size) + lookup_pool_offset),
-			sizeof(void *), &iter);
-		node = cds_lfht_iter_get_test_node(&iter);
-		if (node == NULL) {
-			if (validate_lookup) {
-				printf("[ERROR] Lookup cannot find initial node.\n");
-				exit(-1);
-			}
-			URCU_TLS(lookup_fail)++;
+		if (lookup_batch) {
+			test_hash_rw_lookup_batch(batch_keys, batch_iters);
 		} else {
-			URCU_TLS(lookup_ok)++;
+			cds_lfht_test_lookup(test_ht,
+				(void *)(((unsigned long) rand_r(&URCU_TLS(rand_lookup)) % lookup_pool_size) + lookup_pool_offset),
+				sizeof(void *), &iter);
+			node = cds_lfht_iter_get_test_node(&iter);
+			if (node == NULL) {
+				if (validate_lookup) {
+					printf("[ERROR] Lookup cannot find initial node.\n");
+					exit(-1);
+				}
+				URCU_TLS(lookup_fail)++;
+			} else {
+				URCU_TLS(lookup_ok)++;
+			}
 		}
 		debug_yield_read();
 		if (caa_unlikely(rduration))
@@ -104,6 +157,8 @@ void *test_hash_rw_thr_reader(void *_count)
 	}
 
 	rcu_unregister_thread();
+	free(batch_keys);
+	free(batch_iters);
 
 	*count = URCU_TLS(nr_reads);
 	printf_verbose("thread_end %s, thread id : %lx, tid %lu\n",
@@ -221,6 +276,58 @@ void *test_hash_rw_thr_writer(void *_count)
 	return ((void*)2);
 }
 
+/*
+ * Bulk load init_populate nodes, with distinct keys as long as the init
+ * pool is large enough.
+ */
+static void test_hash_rw_bulk_load(void)
+{
+	struct cds_lfht_node **nodes;
+	unsigned long *hashes;
+	unsigned long i;
+
+	nodes = calloc(init_populate, sizeof(*nodes));
+	hashes = calloc(init_populate, sizeof(*hashes));
+	if (!nodes || !hashes) {
+		perror("calloc");
+		exit(-1);
+	}
+	for (i = 0; i < init_populate; i++) {
+		struct lfht_test_node *node;
+
+		node = malloc(sizeof(struct lfht_test_node));
+		lfht_test_node_init(node,
+			(void *)((i % init_pool_size) + init_pool_offset),
+			sizeof(void *));
+		nodes[i] = &node->node;
+		hashes[i] = test_hash(node->key, node->key_len, TEST_HASH_SEED);
+	}
+	if (cds_lfht_bulk_load(test_ht, nodes, hashes, init_populate)) {
+		printf("bulk load failed on an empty table\n");
+		exit(-1);
+	}
+	URCU_TLS(nr_add) += init_populate;
+	URCU_TLS(nr_writes) += init_populate;
+
+	/* The table is no longer empty: a second bulk load is refused. */
+	if (init_populate) {
+		struct lfht_test_node *node;
+
+		node = malloc(sizeof(struct lfht_test_node));
+		lfht_test_node_init(node, (void *) init_pool_offset,
+			sizeof(void *));
+		nodes[0] = &node->node;
+		hashes[0] = test_hash(node->key, node->key_len, TEST_HASH_SEED);
+		if (cds_lfht_bulk_load(test_ht, nodes, hashes, 1) != -EPERM) {
+			printf("bulk load succeeded on a populated table\n");
+			exit(-1);
+		}
+		free(node);
+	}
+	free(hashes);
+	free(nodes);
+}
+
 int test_hash_rw_populate_hash(void)
 {
 	struct lfht_test_node *node;
@@ -231,6 +338,11 @@ int test_hash_rw_populate_hash(void)
 
 	printf("Starting rw test\n");
 
+	if (opt_bulk_load) {
+		test_hash_rw_bulk_load();
+		return 0;
+	}
+
 	if ((add_unique || add_replace) && init_populate * 10 > init_pool_size) {
 		printf("WARNING: required to populate %lu nodes (-k), but random "
 "pool is quite small (%lu values) and we are in add_unique (-u) or add_replace (-s) mode. Try with a "
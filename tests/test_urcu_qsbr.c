@@ -33,6 +33,7 @@
 #include <assert.h>
 #include <sched.h>
 #include <errno.h>
+#include <poll.h>
 
 #include <urcu/arch.h>
 #include <urcu/tls-compat.h>
@@ -74,6 +75,8 @@ static volatile int test_go, test_stop;
 
 static unsigned long wdelay;
 
+static int expedited;
+
 static struct test_array *test_rcu_pointer;
 
 static unsigned long duration;
@@ -216,6 +219,96 @@ static void test_array_free(struct test_array *ptr)
 	ptr->a = ARRAY_POISON;
 }
 
+static void print_reader_stats(const struct rcu_qsbr_reader_stats *stats,
+		void *priv)
+{
+	if (!pthread_equal(stats->tid, pthread_self()))
+		return;
+	printf_verbose("reader stalls %lu, max %llu ns, total %llu ns\n",
+			stats->stalls,
+			(unsigned long long) stats->stall_max_ns,
+			(unsigned long long) stats->stall_total_ns);
+}
+
+/*
+ * Readers of check_reader_stats(): the online reader delays its
+ * quiescent state by 100 ms, then both block in rcu_qsbr_poll() until
+ * the pipe is written to.
+ */
+static int stats_pipe[2];
+static int stats_ready;
+static pthread_t stats_online_tid, stats_offline_tid;
+static long stats_online_stalls = -1, stats_offline_stalls = -1;
+
+static void stats_wait_pipe(void)
+{
+	struct pollfd pfd = { .fd = stats_pipe[0], .events = POLLIN };
+
+	while (rcu_qsbr_poll(&pfd, 1, -1) < 0 && errno == EINTR)
+		;
+}
+
+static void *thr_stats_online(void *arg)
+{
+	rcu_register_thread();
+	uatomic_inc(&stats_ready);
+	poll(NULL, 0, 100);
+	rcu_quiescent_state();
+	stats_wait_pipe();
+	rcu_unregister_thread();
+	return NULL;
+}
+
+static void *thr_stats_offline(void *arg)
+{
+	rcu_register_thread();
+	uatomic_inc(&stats_ready);
+	stats_wait_pipe();
+	rcu_unregister_thread();
+	return NULL;
+}
+
+static void get_reader_stalls(const struct rcu_qsbr_reader_stats *stats,
+		void *priv)
+{
+	if (pthread_equal(stats->tid, stats_online_tid))
+		stats_online_stalls = stats->stalls;
+	else if (pthread_equal(stats->tid, stats_offline_tid))
+		stats_offline_stalls = stats->stalls;
+}
+
+/*
+ * Check that a grace period sleeps waiting for a reader staying online,
+ * and does not wait for a reader blocked in rcu_qsbr_poll(), which would
+ * otherwise hang this test. Returns nonzero on failure.
+ */
+static int check_reader_stats(void)
+{
+	void *tret;
+
+	if (pipe(stats_pipe))
+		return 1;
+	if (pthread_create(&stats_online_tid, NULL, thr_stats_online, NULL)
+			|| pthread_create(&stats_offline_tid, NULL,
+				thr_stats_offline, NULL))
+		return 1;
+	while (uatomic_read(&stats_ready) < 2)
+		poll(NULL, 0, 1);
+	synchronize_rcu();
+	rcu_qsbr_for_each_reader_stats(get_reader_stalls, NULL);
+	printf_verbose("online reader stalls %ld, offline reader stalls %ld\n",
+		stats_online_stalls, stats_offline_stalls);
+
+	if (write(stats_pipe[1], "", 1) != 1)
+		return 1;
+	if (pthread_join(stats_online_tid, &tret)
+			|| pthread_join(stats_offline_tid, &tret))
+		return 1;
+	close(stats_pipe[0]);
+	close(stats_pipe[1]);
+	return stats_online_stalls <= 0 || stats_offline_stalls != 0;
+}
+
 void *thr_reader(void *_count)
 {
 	unsigned long long *count = _count;
@@ -246,10 +339,14 @@ void *thr_reader(void *_count)
 		/* QS each 1024 reads */
 		if (caa_unlikely((URCU_TLS(nr_reads) & ((1 << 10) - 1)) == 0))
 			rcu_quiescent_state();
+		/* Blocking call in extended QS each 65536 reads */
+		if (caa_unlikely((URCU_TLS(nr_reads) & ((1 << 16) - 1)) == 0))
+			(void) rcu_qsbr_poll(NULL, 0, 0);
 		if (caa_unlikely(!test_duration_read()))
 			break;
 	}
 
+	rcu_qsbr_for_each_reader_stats(print_reader_stats, NULL);
 	rcu_unregister_thread();
 
 	/* test extra thread registration */
@@ -285,7 +382,10 @@ void *thr_writer(void *_count)
 		old = rcu_xchg_pointer(&test_rcu_pointer, new);
 		if (caa_unlikely(wduration))
 			loop_sleep(wduration);
-		synchronize_rcu();
+		if (expedited)
+			synchronize_rcu_expedited();
+		else
+			synchronize_rcu();
 		/* can be done after unlock */
 		if (old)
 			old->a = 0;
@@ -313,6 +413,7 @@ void show_usage(int argc, char **argv)
 	printf(" [-d delay] (writer period (us))");
 	printf(" [-c duration] (reader C.S. duration (in loops))");
 	printf(" [-e duration] (writer C.S. duration (in loops))");
+	printf(" [-x] (expedited grace periods)");
 	printf(" [-v] (verbose output)");
 	printf(" [-a cpu#] [-a cpu#]... (affinity)");
 	printf("\n");
@@ -393,6 +494,9 @@ int main(int argc, char **argv)
 			}
 			wduration = atol(argv[++i]);
 			break;
+		case 'x':
+			expedited = 1;
+			break;
 		case 'v':
 			verbose_mode = 1;
 			break;
@@ -450,6 +554,10 @@ int main(int argc, char **argv)
 	
 	printf_verbose("total number of reads : %llu, writes %llu\n", tot_reads,
 	       tot_writes);
+	if (check_reader_stats()) {
+		fprintf(stderr, "reader stall statistics mismatch\n");
+		exit(1);
+	}
 	printf("SUMMARY %-25s testdur %4lu nr_readers %3u rdur %6lu wdur %6lu "
 		"nr_writers %3u "
 		"wdelay %6lu nr_reads %12llu nr_writes %12llu nr_ops %12llu\n",
@@ -43,6 +43,7 @@
 #include "urcu/tls-compat.h"
 
 #include "urcu-die.h"
+#include "urcu-wait.h"
 
 /* Do not #define _LGPL_SOURCE to ensure we can emit the wrapper symbols */
 #undef _LGPL_SOURCE
@@ -53,56 +54,42 @@
 #define MAP_ANONYMOUS MAP_ANON
 #endif
 
-#ifdef __linux__
-static
-void *mremap_wrapper(void *old_address, size_t old_size,
-		size_t new_size, int flags)
-{
-	return mremap(old_address, old_size, new_size, flags);
-}
-#else
-
-#define MREMAP_MAYMOVE	1
-#define MREMAP_FIXED	2
-
-/*
- * mremap wrapper for non-Linux systems. Maps a RW, anonymous private mapping.
- * This is not generic.
-*/
-static
-void *mremap_wrapper(void *old_address, size_t old_size,
-		size_t new_size, int flags)
-{
-	void *new_address;
-
-	assert(flags & MREMAP_MAYMOVE);
-	assert(!(flags & MREMAP_FIXED));
-	new_address = mmap(old_address, new_size,
-			   PROT_READ | PROT_WRITE,
-			   MAP_ANONYMOUS | MAP_PRIVATE,
-			   -1, 0);
-	if (new_address == MAP_FAILED)
-		return MAP_FAILED;
-	if (old_address) {
-		memcpy(new_address, old_address, old_size);
-		munmap(old_address, old_size);
-	}
-	return new_address;
-}
-#endif
-
 /* Sleep delay in us */
 #define RCU_SLEEP_DELAY		1000
+/* Number of entries of the first registry arena chunk */
 #define ARENA_INIT_ALLOC	16
 
 /*
- * Active attempts to check for reader Q.S. before calling sleep().
+ * Initial active attempts to check for reader Q.S. before calling sleep(),
+ * adapted to the readers at runtime by urcu-spin-impl.h.
  */
 #define RCU_QS_ACTIVE_ATTEMPTS 100
 
+#define RCU_FLAVOR_NAME	"bp"
+
+#include "urcu-stall-impl.h"
+#include "urcu-trace-impl.h"
+#include "urcu-stats-impl.h"
+#include "urcu-spin-impl.h"
+
 void __attribute__((destructor)) rcu_bp_exit(void);
 
+/*
+ * rcu_gp_lock ensures mutual exclusion between threads calling
+ * synchronize_rcu().
+ */
 static pthread_mutex_t rcu_gp_lock = PTHREAD_MUTEX_INITIALIZER;
+/*
+ * rcu_registry_lock ensures mutual exclusion between threads
+ * registering and unregistering themselves to/from the registry, and
+ * with threads reading that registry from synchronize_rcu(). However,
+ * this lock is not held all the way through the completion of awaiting
+ * for the grace period. It is sporadically released between iterations
+ * on the registry, so thread registration does not have to wait for a
+ * whole grace period to complete.
+ * rcu_registry_lock may nest inside rcu_gp_lock.
+ */
+static pthread_mutex_t rcu_registry_lock = PTHREAD_MUTEX_INITIALIZER;
 
 #ifdef DEBUG_YIELD
 unsigned int yield_active;
@@ -125,18 +112,71 @@ DEFINE_URCU_TLS(struct rcu_reader *, rcu_reader);
 
 static CDS_LIST_HEAD(registry);
 
+/*
+ * Grace period sequence number for the polling API. Odd while a grace
+ * period is in progress. Written to only by writer with mutex taken.
+ */
+static unsigned long rcu_gp_seq;
+
+/*
+ * Queue keeping threads awaiting to wait for a grace period. Contains
+ * struct urcu_wait_node objects, allocated on the waiters' stacks.
+ */
+static DEFINE_URCU_WAIT_QUEUE(gp_waiters);
+
+/*
+ * Number of synchronize_rcu_expedited() calls in progress. While
+ * non-zero, grace periods busy-wait for readers instead of sleeping.
+ */
+static int gp_expedited;
+
+/*
+ * Set to -1 while a grace period sleeps for RCU_SLEEP_DELAY waiting for
+ * readers. Readers never wake it up: synchronize_rcu_expedited() does.
+ */
+static int32_t gp_futex;
+
+/*
+ * The registry arena is made of chunks, each mapped separately, so
+ * growing the arena never moves the entries threads point to. Each
+ * chunk keeps its free entries in a list, linked through their registry
+ * node, and chunks with free entries are kept in a list of their own,
+ * so registration does not search for a free entry. A chunk is unmapped
+ * as soon as all its entries are free, unless it is the last one.
+ */
+struct registry_chunk {
+	struct cds_list_head node;	/* in registry_arena.chunks */
+	struct cds_list_head free_node;	/* in registry_arena.free_chunks */
+	struct cds_list_head free;	/* free entries */
+	size_t capacity;		/* number of entries */
+	size_t used;			/* number of allocated entries */
+	size_t len;			/* size of the mapping */
+	struct rcu_reader entries[];
+};
+
 struct registry_arena {
-	void *p;
-	size_t len;
-	size_t used;
+	struct cds_list_head chunks;
+	struct cds_list_head free_chunks;
+	size_t capacity;		/* total number of entries */
 };
 
-static struct registry_arena registry_arena;
+static struct registry_arena registry_arena = {
+	.chunks = CDS_LIST_HEAD_INIT(registry_arena.chunks),
+	.free_chunks = CDS_LIST_HEAD_INIT(registry_arena.free_chunks),
+};
 
-/* Saved fork signal mask, protected by rcu_gp_lock */
+/* Saved fork signal mask, protected by rcu_gp_lock and rcu_registry_lock */
 static sigset_t saved_fork_signal_mask;
 
-static void rcu_gc_registry(void);
+/*
+ * The destructor of this key removes exiting threads from the registry.
+ * Its value is the thread's registry entry. Created on first
+ * registration, protected by rcu_registry_lock.
+ */
+static pthread_key_t registry_key;
+static int registry_key_created;
+
+static void rcu_bp_thread_exit(void *arg);
 
 static void mutex_lock(pthread_mutex_t *mutex)
 {
@@ -164,14 +204,72 @@ static void mutex_unlock(pthread_mutex_t *mutex)
 		urcu_die(ret);
 }
 
+/*
+ * Report the readers the grace period is still waiting for. Called
+ * with the registry lock held.
+ */
+static void report_stalled_readers(struct urcu_stall_check *stall)
+{
+	struct rcu_reader *index;
+
+	cds_list_for_each_entry(index, &registry, node) {
+		urcu_stall_report(stall, index->tid,
+			(CMM_LOAD_SHARED(index->ctr) & RCU_GP_CTR_NEST_MASK)
+				/ RCU_GP_COUNT);
+	}
+}
+
+/*
+ * Sleep for RCU_SLEEP_DELAY, unless synchronize_rcu_expedited() is
+ * called meanwhile.
+ */
+static void wait_gp(void)
+{
+	struct timespec timeout;
+
+	timeout.tv_sec = RCU_SLEEP_DELAY / 1000000;
+	timeout.tv_nsec = (RCU_SLEEP_DELAY % 1000000) * 1000;
+	uatomic_set(&gp_futex, -1);
+	/* Write futex before reading gp_expedited */
+	cmm_smp_mb();
+	if (!uatomic_read(&gp_expedited)) {
+		urcu_stats_sleep();
+		urcu_trace(RCU_TRACE_GP_SLEEP, 0);
+		futex_async(&gp_futex, FUTEX_WAIT, -1, &timeout, NULL, 0);
+		urcu_trace(RCU_TRACE_GP_WAKEUP, 0);
+	}
+	uatomic_set(&gp_futex, 0);
+}
+
+static void wake_up_gp(void)
+{
+	if (caa_unlikely(uatomic_read(&gp_futex) == -1)) {
+		uatomic_set(&gp_futex, 0);
+		futex_async(&gp_futex, FUTEX_WAKE, 1, NULL, NULL, 0);
+	}
+}
+
+/*
+ * Always called with rcu_registry lock held. Releases this lock between
+ * iterations and grabs it again. Holds the lock when it returns.
+ */
 void update_counter_and_wait(void)
 {
 	CDS_LIST_HEAD(qsreaders);
-	int wait_loops = 0;
+	struct urcu_stall_check stall;
+	struct urcu_spin spin;
+	unsigned int attempts, wait_loops = 0;
 	struct rcu_reader *index, *tmp;
+	unsigned long nr_scanned;
 
+#ifdef RCU_GP_SINGLE_FLIP
+	/* Increment current G.P. */
+	CMM_STORE_SHARED(rcu_gp_ctr,
+		(long) ((unsigned long) rcu_gp_ctr + RCU_GP_CTR_PHASE));
+#else	/* #ifdef RCU_GP_SINGLE_FLIP */
 	/* Switch parity: 0 -> 1, 1 -> 0 */
 	CMM_STORE_SHARED(rcu_gp_ctr, rcu_gp_ctr ^ RCU_GP_CTR_PHASE);
+#endif	/* #else #ifdef RCU_GP_SINGLE_FLIP */
 
 	/*
 	 * Must commit qparity update to memory before waiting for other parity
@@ -187,41 +285,104 @@ void update_counter_and_wait(void)
 	 */
 	cmm_smp_mb();
 
+	urcu_stall_check_init(&stall, RCU_FLAVOR_NAME);
+	attempts = urcu_spin_begin(&spin);
+
 	/*
 	 * Wait for each thread rcu_reader.ctr count to become 0.
+	 * Once the busy-wait attempts are exhausted, each loop sleeps.
 	 */
 	for (;;) {
-		wait_loops++;
+		if (wait_loops < attempts)
+			wait_loops++;
+		/* Expedited grace period: keep busy-waiting. */
+		if (wait_loops == attempts && uatomic_read(&gp_expedited)) {
+			urcu_spin_discard(&spin);
+			wait_loops = 0;
+		}
+		nr_scanned = 0;
 		cds_list_for_each_entry_safe(index, tmp, &registry, node) {
+			nr_scanned++;
 			if (!rcu_old_gp_ongoing(&index->ctr))
 				cds_list_move(&index->node, &qsreaders);
 		}
+		urcu_stats_scanned(nr_scanned);
 
 		if (cds_list_empty(&registry)) {
 			break;
 		} else {
-			if (wait_loops == RCU_QS_ACTIVE_ATTEMPTS)
-				usleep(RCU_SLEEP_DELAY);
-			else
+			if (urcu_stall_check_due(&stall))
+				report_stalled_readers(&stall);
+			/* Temporarily unlock the registry lock. */
+			mutex_unlock(&rcu_registry_lock);
+			if (wait_loops == attempts
+			    && !uatomic_read(&gp_expedited)) {
+				wait_gp();
+			} else {
 				caa_cpu_relax();
+			}
+			/* Re-lock the registry lock before the next loop. */
+			mutex_lock(&rcu_registry_lock);
 		}
 	}
+	urcu_spin_end(&spin, wait_loops);
+	urcu_trace(RCU_TRACE_GP_PHASE, wait_loops);
 	/* put back the reader list in the registry */
 	cds_list_splice(&qsreaders, &registry);
 }
 
-void synchronize_rcu(void)
+static void __synchronize_rcu(int expedited)
 {
+	DEFINE_URCU_WAIT_NODE(wait, URCU_WAIT_WAITING);
+	struct urcu_waiters waiters;
 	sigset_t newmask, oldmask;
 	int ret;
 
-	ret = sigemptyset(&newmask);
+	ret = sigfillset(&newmask);
 	assert(!ret);
 	ret = pthread_sigmask(SIG_SETMASK, &newmask, &oldmask);
 	assert(!ret);
 
+	/*
+	 * Add ourself to gp_waiters queue of threads awaiting to wait
+	 * for a grace period. Proceed to perform the grace period only
+	 * if we are the first thread added into the queue.
+	 * The implicit memory barrier before urcu_wait_add()
+	 * orders prior memory accesses of threads put into the wait
+	 * queue before their insertion into the wait queue.
+	 */
+	if (urcu_wait_add(&gp_waiters, &wait) != 0) {
+		/* Not first in queue: will be awakened by another thread. */
+		if (expedited)
+			urcu_busy_wait(&wait);
+		else
+			urcu_adaptative_busy_wait(&wait);
+		/* Order following memory accesses after grace period. */
+		cmm_smp_mb();
+		goto gp_end;
+	}
+	/* We won't need to wake ourself up */
+	urcu_wait_set_state(&wait, URCU_WAIT_RUNNING);
+
 	mutex_lock(&rcu_gp_lock);
 
+	/*
+	 * Move all waiters into our local queue. They have all been
+	 * queued before we start the grace period, so the grace period
+	 * performed below is also theirs.
+	 */
+	urcu_move_waiters(&waiters, &gp_waiters);
+
+	/*
+	 * Start grace period sequence for the polling API. Ordered before
+	 * the counter update by the following memory barrier.
+	 */
+	CMM_STORE_SHARED(rcu_gp_seq, rcu_gp_seq + 1);
+	urcu_trace(RCU_TRACE_GP_BEGIN, expedited);
+	urcu_stats_gp_begin();
+
+	mutex_lock(&rcu_registry_lock);
+
 	if (cds_list_empty(&registry))
 		goto out;
 
@@ -230,9 +391,12 @@ void synchronize_rcu(void)
 	/* Write new ptr before changing the qparity */
 	cmm_smp_mb();
 
-	/* Remove old registry elements */
-	rcu_gc_registry();
-
+#ifdef RCU_GP_SINGLE_FLIP
+	/*
+	 * Wait for readers which started before the counter increment.
+	 */
+	update_counter_and_wait();
+#else	/* #ifdef RCU_GP_SINGLE_FLIP */
 	/*
 	 * Wait for previous parity to be empty of readers.
 	 */
@@ -249,6 +413,7 @@ void synchronize_rcu(void)
 	 * Wait for previous parity to be empty of readers.
 	 */
 	update_counter_and_wait();	/* 1 -> 0, wait readers in parity 1 */
+#endif	/* #else #ifdef RCU_GP_SINGLE_FLIP */
 
 	/*
 	 * Finish waiting for reader threads before letting the old ptr being
@@ -256,11 +421,43 @@ void synchronize_rcu(void)
 	 */
 	cmm_smp_mb();
 out:
+	mutex_unlock(&rcu_registry_lock);
+	/* End grace period sequence after reader accesses. */
+	cmm_smp_mb();
+	urcu_stats_gp_end(expedited);
+	CMM_STORE_SHARED(rcu_gp_seq, rcu_gp_seq + 1);
+	urcu_trace(RCU_TRACE_GP_END, expedited);
 	mutex_unlock(&rcu_gp_lock);
+
+	/*
+	 * Wakeup waiters only after we have completed the grace period
+	 * and have ensured the memory barriers at the end of the grace
+	 * period have been issued.
+	 */
+	urcu_wake_all_waiters(&waiters);
+gp_end:
 	ret = pthread_sigmask(SIG_SETMASK, &oldmask, NULL);
 	assert(!ret);
 }
 
+void synchronize_rcu(void)
+{
+	__synchronize_rcu(0);
+}
+
+void synchronize_rcu_expedited(void)
+{
+	uatomic_inc(&gp_expedited);
+	/*
+	 * Increment gp_expedited before reading gp_futex: a grace period
+	 * sleeping for readers is woken up, and busy-waits from now on.
+	 */
+	cmm_smp_mb();
+	wake_up_gp();
+	__synchronize_rcu(1);
+	uatomic_dec(&gp_expedited);
+}
+
 /*
  * library wrappers to be used by non-LGPL compatible source code.
  */
@@ -276,82 +473,105 @@ void rcu_read_unlock(void)
 }
 
 /*
- * only grow for now.
+ * Add a chunk as large as all existing chunks, so the number of chunks
+ * stays logarithmic in the number of threads.
  */
-static void resize_arena(struct registry_arena *arena, size_t len)
+static void expand_arena(struct registry_arena *arena)
 {
-	void *new_arena;
-
-	if (!arena->p)
-		new_arena = mmap(arena->p, len,
-				 PROT_READ | PROT_WRITE,
-				 MAP_ANONYMOUS | MAP_PRIVATE,
-				 -1, 0);
-	else
-		new_arena = mremap_wrapper(arena->p, arena->len,
-				   	len, MREMAP_MAYMOVE);
-	assert(new_arena != MAP_FAILED);
+	struct registry_chunk *chunk;
+	size_t capacity, len, i;
+
+	capacity = caa_max(arena->capacity, ARENA_INIT_ALLOC);
+	len = sizeof(struct registry_chunk)
+		+ capacity * sizeof(struct rcu_reader);
+	chunk = mmap(NULL, len, PROT_READ | PROT_WRITE,
+		     MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+	if (chunk == MAP_FAILED)
+		urcu_die(errno);
+	/* Anonymous mappings are zero-filled. */
+	chunk->capacity = capacity;
+	chunk->len = len;
+	CDS_INIT_LIST_HEAD(&chunk->free);
+	for (i = 0; i < capacity; i++)
+		cds_list_add_tail(&chunk->entries[i].node, &chunk->free);
+	cds_list_add_tail(&chunk->node, &arena->chunks);
+	cds_list_add(&chunk->free_node, &arena->free_chunks);
+	arena->capacity += capacity;
+}
 
-	/*
-	 * re-used the same region ?
-	 */
-	if (new_arena == arena->p)
-		return;
+static void release_chunk(struct registry_arena *arena,
+		struct registry_chunk *chunk)
+{
+	cds_list_del(&chunk->node);
+	cds_list_del(&chunk->free_node);
+	arena->capacity -= chunk->capacity;
+	if (munmap(chunk, chunk->len))
+		urcu_die(errno);
+}
+
+static struct registry_chunk *entry_chunk(struct registry_arena *arena,
+		struct rcu_reader *rcu_reader_reg)
+{
+	struct registry_chunk *chunk;
 
-	bzero(new_arena + arena->len, len - arena->len);
-	arena->p = new_arena;
+	cds_list_for_each_entry(chunk, &arena->chunks, node) {
+		if (rcu_reader_reg >= chunk->entries
+		    && rcu_reader_reg < chunk->entries + chunk->capacity)
+			return chunk;
+	}
+	assert(0);
+	return NULL;
 }
 
-/* Called with signals off and mutex locked */
+/* Called with signals off and registry mutex locked */
 static void add_thread(void)
 {
+	struct registry_chunk *chunk;
 	struct rcu_reader *rcu_reader_reg;
+	int ret;
 
-	if (registry_arena.len
-	    < registry_arena.used + sizeof(struct rcu_reader))
-		resize_arena(&registry_arena,
-		caa_max(registry_arena.len << 1, ARENA_INIT_ALLOC));
-	/*
-	 * Find a free spot.
-	 */
-	for (rcu_reader_reg = registry_arena.p;
-	     (void *)rcu_reader_reg < registry_arena.p + registry_arena.len;
-	     rcu_reader_reg++) {
-		if (!rcu_reader_reg->alloc)
-			break;
+	if (!registry_key_created) {
+		ret = pthread_key_create(&registry_key, rcu_bp_thread_exit);
+		if (ret)
+			urcu_die(ret);
+		registry_key_created = 1;
 	}
+	if (cds_list_empty(&registry_arena.free_chunks))
+		expand_arena(&registry_arena);
+	chunk = cds_list_entry(registry_arena.free_chunks.next,
+			struct registry_chunk, free_node);
+	rcu_reader_reg = cds_list_entry(chunk->free.next,
+			struct rcu_reader, node);
+	cds_list_del(&rcu_reader_reg->node);
+	if (++chunk->used == chunk->capacity)
+		cds_list_del_init(&chunk->free_node);
 	rcu_reader_reg->alloc = 1;
-	registry_arena.used += sizeof(struct rcu_reader);
 
 	/* Add to registry */
 	rcu_reader_reg->tid = pthread_self();
 	assert(rcu_reader_reg->ctr == 0);
 	cds_list_add(&rcu_reader_reg->node, &registry);
 	URCU_TLS(rcu_reader) = rcu_reader_reg;
+	/* Arm the key destructor, which removes us when we exit. */
+	ret = pthread_setspecific(registry_key, rcu_reader_reg);
+	if (ret)
+		urcu_die(ret);
 }
 
-/* Called with signals off and mutex locked */
-static void rcu_gc_registry(void)
+/* Called with signals off and registry mutex locked */
+static void remove_thread(struct rcu_reader *rcu_reader_reg)
 {
-	struct rcu_reader *rcu_reader_reg;
-	pthread_t tid;
-	int ret;
-
-	for (rcu_reader_reg = registry_arena.p;
-	     (void *)rcu_reader_reg < registry_arena.p + registry_arena.len;
-	     rcu_reader_reg++) {
-		if (!rcu_reader_reg->alloc)
-			continue;
-		tid = rcu_reader_reg->tid;
-		ret = pthread_kill(tid, 0);
-		assert(ret != EINVAL);
-		if (ret == ESRCH) {
-			cds_list_del(&rcu_reader_reg->node);
-			rcu_reader_reg->ctr = 0;
-			rcu_reader_reg->alloc = 0;
-			registry_arena.used -= sizeof(struct rcu_reader);
-		}
-	}
+	struct registry_chunk *chunk;
+
+	chunk = entry_chunk(&registry_arena, rcu_reader_reg);
+	cds_list_del(&rcu_reader_reg->node);
+	rcu_reader_reg->ctr = 0;
+	rcu_reader_reg->alloc = 0;
+	cds_list_add(&rcu_reader_reg->node, &chunk->free);
+	if (chunk->used-- == chunk->capacity)
+		cds_list_add(&chunk->free_node, &registry_arena.free_chunks);
+	if (!chunk->used && registry_arena.capacity > chunk->capacity)
+		release_chunk(&registry_arena, chunk);
 }
 
 /* Disable signals, take mutex, add to registry */
@@ -360,7 +580,7 @@ void rcu_bp_register(void)
 	sigset_t newmask, oldmask;
 	int ret;
 
-	ret = sigemptyset(&newmask);
+	ret = sigfillset(&newmask);
 	assert(!ret);
 	ret = pthread_sigmask(SIG_SETMASK, &newmask, &oldmask);
 	assert(!ret);
@@ -371,35 +591,71 @@ void rcu_bp_register(void)
 	if (URCU_TLS(rcu_reader))
 		goto end;
 
-	mutex_lock(&rcu_gp_lock);
+	mutex_lock(&rcu_registry_lock);
 	add_thread();
-	mutex_unlock(&rcu_gp_lock);
+	mutex_unlock(&rcu_registry_lock);
 end:
 	ret = pthread_sigmask(SIG_SETMASK, &oldmask, NULL);
 	assert(!ret);
 }
 
+/*
+ * Key destructor, run by exiting threads which registered. Removes the
+ * thread from the registry, so grace periods neither need to look for
+ * dead threads nor wait for them. A destructor of another key may use
+ * the read-side afterwards: the thread then registers again, which
+ * re-arms this destructor.
+ */
+static void rcu_bp_thread_exit(void *arg)
+{
+	struct rcu_reader *rcu_reader_reg = arg;
+	sigset_t newmask, oldmask;
+	int ret;
+
+	ret = sigfillset(&newmask);
+	assert(!ret);
+	ret = pthread_sigmask(SIG_SETMASK, &newmask, &oldmask);
+	assert(!ret);
+
+	assert(!(rcu_reader_reg->ctr & RCU_GP_CTR_NEST_MASK));
+	mutex_lock(&rcu_registry_lock);
+	remove_thread(rcu_reader_reg);
+	URCU_TLS(rcu_reader) = NULL;
+	mutex_unlock(&rcu_registry_lock);
+
+	ret = pthread_sigmask(SIG_SETMASK, &oldmask, NULL);
+	assert(!ret);
+}
+
 void rcu_bp_exit(void)
 {
-	if (registry_arena.p)
-		munmap(registry_arena.p, registry_arena.len);
+	struct registry_chunk *chunk, *tmp;
+
+	/* Do not run our destructor once the library is unloaded. */
+	if (registry_key_created)
+		pthread_key_delete(registry_key);
+	urcu_trace_exit();
+	cds_list_for_each_entry_safe(chunk, tmp, &registry_arena.chunks, node)
+		munmap(chunk, chunk->len);
 }
 
 /*
- * Holding the rcu_gp_lock across fork will make sure we fork() don't race with
- * a concurrent thread executing with this same lock held. This ensures that the
- * registry is in a coherent state in the child.
+ * Holding the rcu_gp_lock and rcu_registry_lock across fork will make
+ * sure we fork() don't race with a concurrent thread executing with
+ * any of those locks held. This ensures that the registry and data
+ * protected by rcu_gp_lock are in a coherent state in the child.
  */
 void rcu_bp_before_fork(void)
 {
 	sigset_t newmask, oldmask;
 	int ret;
 
-	ret = sigemptyset(&newmask);
+	ret = sigfillset(&newmask);
 	assert(!ret);
 	ret = pthread_sigmask(SIG_SETMASK, &newmask, &oldmask);
 	assert(!ret);
 	mutex_lock(&rcu_gp_lock);
+	mutex_lock(&rcu_registry_lock);
 	saved_fork_signal_mask = oldmask;
 }
 
@@ -409,6 +665,7 @@ void rcu_bp_after_fork_parent(void)
 	int ret;
 
 	oldmask = saved_fork_signal_mask;
+	mutex_unlock(&rcu_registry_lock);
 	mutex_unlock(&rcu_gp_lock);
 	ret = pthread_sigmask(SIG_SETMASK, &oldmask, NULL);
 	assert(!ret);
@@ -417,10 +674,16 @@ void rcu_bp_after_fork_parent(void)
 void rcu_bp_after_fork_child(void)
 {
 	sigset_t oldmask;
+	struct rcu_reader *rcu_reader_reg, *tmp;
 	int ret;
 
-	rcu_gc_registry();
+	/* Only the forking thread exists in the child. */
+	cds_list_for_each_entry_safe(rcu_reader_reg, tmp, &registry, node) {
+		if (rcu_reader_reg != URCU_TLS(rcu_reader))
+			remove_thread(rcu_reader_reg);
+	}
 	oldmask = saved_fork_signal_mask;
+	mutex_unlock(&rcu_registry_lock);
 	mutex_unlock(&rcu_gp_lock);
 	ret = pthread_sigmask(SIG_SETMASK, &oldmask, NULL);
 	assert(!ret);
@@ -454,3 +717,4 @@ DEFINE_RCU_FLAVOR(rcu_flavor);
 
 #include "urcu-call-rcu-impl.h"
 #include "urcu-defer-impl.h"
+#include "urcu-poll-impl.h"
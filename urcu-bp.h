@@ -133,6 +133,14 @@ extern void *rcu_set_pointer_sym_bp(void **p, void *v);
 #endif /* !_LGPL_SOURCE */
 
 extern void synchronize_rcu(void);
+extern void synchronize_rcu_expedited(void);
+
+/*
+ * Bounds of the number of busy-wait loops of synchronize_rcu() before
+ * it sleeps waiting for readers.
+ */
+extern int rcu_set_wait_spin(unsigned int min_attempts,
+			     unsigned int max_attempts);
 
 /*
  * rcu_bp_before_fork, rcu_bp_after_fork_parent and rcu_bp_after_fork_child
@@ -180,6 +188,10 @@ static inline void rcu_thread_online(void)
 
 #include <urcu-call-rcu.h>
 #include <urcu-defer.h>
+#include <urcu-poll.h>
+#include <urcu-stall.h>
+#include <urcu-trace.h>
+#include <urcu-stats.h>
 #include <urcu-flavor.h>
 
 #endif /* _URCU_BP_H */
@@ -33,6 +33,7 @@
 #include <sys/time.h>
 #include <unistd.h>
 #include <sched.h>
+#include <dirent.h>
 
 #include "config.h"
 #include "urcu/wfqueue.h"
@@ -41,7 +42,49 @@
 #include "urcu/list.h"
 #include "urcu/futex.h"
 #include "urcu/tls-compat.h"
+#include "urcu/ref.h"
 #include "urcu-die.h"
+#include "urcu-wait.h"
+
+/*
+ * Default batching delay of call_rcu threads, in microseconds: time
+ * waited for more callbacks to be queued before starting a grace
+ * period. Tunable per call_rcu_data with set_call_rcu_data_batching().
+ */
+#define URCU_CALL_RCU_BATCH_DELAY_US	10000
+
+/*
+ * Default queue length cutting the batching delay short. 0 disables it.
+ */
+#define URCU_CALL_RCU_QLEN_THRESHOLD	0
+
+/*
+ * Number of busy-loop attempts before sleeping while waiting for a
+ * concurrent call_rcu() to link its callback.
+ */
+#define CALL_RCU_ADAPT_ATTEMPTS		1000
+#define CALL_RCU_WAIT			1	/* Sleep 1 ms if being linked */
+
+/*
+ * Value of the futex while the call_rcu thread waits within its
+ * batching delay. Only a queue length reaching the threshold, or a
+ * stop request, wakes it up early.
+ */
+#define CALL_RCU_FUTEX_BATCH		-2
+
+/*
+ * Affinity applied by the last attempt of a call_rcu thread to pin
+ * itself: its CPU or node, its inherited affinity, or else the NUMA
+ * node whose CPUs it fell back on.
+ */
+#define CALL_RCU_AFFINITY_TARGET	-2
+#define CALL_RCU_AFFINITY_INHERITED	-1
+
+/*
+ * Number of wakeups between attempts to get back to a CPU or node which
+ * was offline or excluded from our cpuset.
+ */
+#define CALL_RCU_REBALANCE_RETRY	100
 
 /* Data structure that identifies a call_rcu thread. */
 
@@ -50,11 +93,43 @@ struct call_rcu_data {
 	unsigned long flags;
 	int32_t futex;
 	unsigned long qlen; /* maintained for debugging. */
+	unsigned long invoked;	/* Callbacks invoked by the call_rcu thread. */
 	pthread_t tid;
 	int cpu_affinity;
+	int numa_node;		/* Node affinity when no CPU affinity. */
+	int affinity_fallback;	/* CALL_RCU_AFFINITY_* or fallback node. */
+	int rebalance_retry;	/* Wakeups until the next fallback retry. */
+	unsigned long batch_delay_us;
+	unsigned long qlen_threshold;
+	unsigned long high_watermark;	/* 0: no backpressure. */
+	int backpressure;		/* URCU_CALL_RCU_BACKPRESSURE_* */
+	struct call_rcu_backpressure_stats backpressure_stats;
+	/*
+	 * Callback batches completed, and call_rcu() callers blocked by
+	 * backpressure waiting for the next batch. Only maintained while
+	 * a high watermark is set.
+	 */
+	unsigned long batch_seq;
+	struct urcu_wait_queue backpressure_waiters;
+	unsigned long backpressure_nr_blocked;	/* Pin crdp while waiting. */
 	struct cds_list_head list;
 } __attribute__((aligned(CAA_CACHE_LINE_SIZE)));
 
+/*
+ * Completion shared by the barrier callbacks queued by a rcu_barrier()
+ * invocation. Freed by the last of the waiter and barrier callbacks.
+ */
+struct call_rcu_completion {
+	int barrier_count;
+	int32_t futex;
+	struct urcu_ref ref;
+};
+
+struct call_rcu_completion_work {
+	struct rcu_head head;
+	struct call_rcu_completion *completion;
+};
+
 /*
  * List of all call_rcu_data structures to keep valgrind happy.
  * Protected by call_rcu_mutex.
@@ -70,10 +145,32 @@ static DEFINE_URCU_TLS(struct call_rcu_data *, thread_call_rcu_data);
 
 static pthread_mutex_t call_rcu_mutex = PTHREAD_MUTEX_INITIALIZER;
 
+/*
+ * Callbacks invoked by the threads of freed call_rcu_data structures.
+ * Protected by call_rcu_mutex.
+ */
+
+static unsigned long long call_rcu_freed_invoked;
+
 /* If a given thread does not have its own call_rcu thread, this is default. */
 
 static struct call_rcu_data *default_call_rcu_data;
 
+/*
+ * NUMA node of each CPU, and per-node call_rcu_data structures used by
+ * CPUs without call_rcu_data of their own. call_rcu_node_map and the
+ * per-node pointers are RCU-protected, updates are protected by
+ * call_rcu_mutex. Allocated once, with the arrays following it.
+ */
+
+struct call_rcu_node_map {
+	long nr_nodes;
+	struct call_rcu_data **crdp;	/* Indexed by node. */
+	int *cpu_node;			/* Indexed by CPU. */
+};
+
+static struct call_rcu_node_map *call_rcu_node_map;
+
 /*
  * If the sched_getcpu() and sysconf(_SC_NPROCESSORS_CONF) calls are
  * available, then we can have call_rcu threads assigned to individual
@@ -123,6 +220,73 @@ static void alloc_cpu_call_rcu_data(void)
 	}
 }
 
+/*
+ * Find the NUMA node of a CPU from the "nodeN" entry of its sysfs
+ * directory. Without this information, all CPUs are on node 0.
+ */
+
+static int lookup_cpu_node(long cpu)
+{
+	char path[64];
+	DIR *dir;
+	struct dirent *entry;
+	int node = 0;
+
+	snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%ld", cpu);
+	dir = opendir(path);
+	if (dir == NULL)
+		return 0;
+	while ((entry = readdir(dir)) != NULL) {
+		if (sscanf(entry->d_name, "node%d", &node) == 1)
+			break;
+		node = 0;
+	}
+	closedir(dir);
+	return node;
+}
+
+/* Allocate the node map if it has not already been allocated. */
+
+static void alloc_node_call_rcu_data(void)
+{
+	struct call_rcu_node_map *map;
+	int *nodes;
+	long cpu, nr_nodes = 0;
+	static int warned = 0;
+
+	alloc_cpu_call_rcu_data();
+	if (call_rcu_node_map != NULL || maxcpus <= 0)
+		return;
+	nodes = malloc(maxcpus * sizeof(*nodes));
+	if (nodes == NULL)
+		goto error;
+	for (cpu = 0; cpu < maxcpus; cpu++) {
+		nodes[cpu] = lookup_cpu_node(cpu);
+		if (nodes[cpu] >= nr_nodes)
+			nr_nodes = nodes[cpu] + 1;
+	}
+	map = malloc(sizeof(*map) + nr_nodes * sizeof(*map->crdp)
+			+ maxcpus * sizeof(*map->cpu_node));
+	if (map == NULL) {
+		free(nodes);
+		goto error;
+	}
+	map->nr_nodes = nr_nodes;
+	map->crdp = (struct call_rcu_data **) (map + 1);
+	memset(map->crdp, '\0', nr_nodes * sizeof(*map->crdp));
+	map->cpu_node = (int *) (map->crdp + nr_nodes);
+	memcpy(map->cpu_node, nodes, maxcpus * sizeof(*nodes));
+	free(nodes);
+	rcu_set_pointer(&call_rcu_node_map, map);
+	return;
+
+error:
+	if (!warned) {
+		fprintf(stderr, "[error] liburcu: unable to allocate per-node pointer array\n");
+	}
+	warned = 1;
+}
+
 #else /* #if defined(HAVE_SCHED_GETCPU) && defined(HAVE_SYSCONF) */
 
 /*
@@ -141,6 +305,10 @@ static void alloc_cpu_call_rcu_data(void)
 {
 }
 
+static void alloc_node_call_rcu_data(void)
+{
+}
+
 static int sched_getcpu(void)
 {
 	return -1;
@@ -170,22 +338,77 @@ static void call_rcu_unlock(pthread_mutex_t *pmp)
 		urcu_die(ret);
 }
 
+/* Return the NUMA node of the specified CPU, -1 if unknown. */
+
+static int call_rcu_cpu_node(int cpu)
+{
+	struct call_rcu_node_map *map;
+
+	map = rcu_dereference(call_rcu_node_map);
+	if (map == NULL || cpu < 0 || maxcpus <= cpu)
+		return -1;
+	return map->cpu_node[cpu];
+}
+
 #if HAVE_SCHED_SETAFFINITY
 static
+int call_rcu_setaffinity(cpu_set_t *mask)
+{
+#if SCHED_SETAFFINITY_ARGS == 2
+	return sched_setaffinity(0, mask);
+#else
+	return sched_setaffinity(0, sizeof(*mask), mask);
+#endif
+}
+
+/*
+ * Pin the call_rcu thread to its CPU, or to the CPUs of its NUMA node.
+ * A CPU which is offline or excluded from our cpuset is refused with
+ * EINVAL: fall back on the CPUs of its node, and then on the affinity
+ * inherited from the kernel.
+ */
+static
 int set_thread_cpu_affinity(struct call_rcu_data *crdp)
 {
+	struct call_rcu_node_map *map;
 	cpu_set_t mask;
+	int node = crdp->numa_node;
+	long cpu;
 
-	if (crdp->cpu_affinity < 0)
+	if (crdp->cpu_affinity < 0 && node < 0)
 		return 0;
 
+	crdp->affinity_fallback = CALL_RCU_AFFINITY_TARGET;
+	crdp->rebalance_retry = CALL_RCU_REBALANCE_RETRY;
+	if (crdp->cpu_affinity >= 0) {
+		/* CPUs beyond cpu_set_t are refused like offline ones. */
+		if (crdp->cpu_affinity < CPU_SETSIZE) {
+			CPU_ZERO(&mask);
+			CPU_SET(crdp->cpu_affinity, &mask);
+			if (!call_rcu_setaffinity(&mask))
+				return 0;
+			if (errno != EINVAL)
+				return -1;
+		}
+		node = call_rcu_cpu_node(crdp->cpu_affinity);
+		crdp->affinity_fallback = node;
+	}
+	map = rcu_dereference(call_rcu_node_map);
+	if (node < 0 || map == NULL) {
+		crdp->affinity_fallback = CALL_RCU_AFFINITY_INHERITED;
+		return 0;
+	}
 	CPU_ZERO(&mask);
-	CPU_SET(crdp->cpu_affinity, &mask);
-#if SCHED_SETAFFINITY_ARGS == 2
-	return sched_setaffinity(0, &mask);
-#else
-	return sched_setaffinity(0, sizeof(mask), &mask);
-#endif
+	for (cpu = 0; cpu < maxcpus && cpu < CPU_SETSIZE; cpu++) {
+		if (map->cpu_node[cpu] == node)
+			CPU_SET(cpu, &mask);
+	}
+	if (call_rcu_setaffinity(&mask)) {
+		if (errno != EINVAL)
+			return -1;
+		crdp->affinity_fallback = CALL_RCU_AFFINITY_INHERITED;
+	}
+	return 0;
 }
 #else
 static
@@ -195,32 +418,239 @@ int set_thread_cpu_affinity(struct call_rcu_data *crdp)
 }
 #endif
 
+/*
+ * CPU hotplug and cpuset changes may have moved the call_rcu thread
+ * away from its CPU or node: try to get back there.
+ *
+ * While the thread still runs within the fallback applied by its last
+ * attempt, the online CPUs and cpuset have not changed in a way that
+ * moved it, so its CPU or node is most likely still unavailable: only
+ * retry every CALL_RCU_REBALANCE_RETRY wakeups, rather than issuing
+ * sched_setaffinity() at each wakeup.
+ */
+static void call_rcu_rebalance(struct call_rcu_data *crdp)
+{
+	int cpu;
+
+	if (crdp->cpu_affinity < 0 && crdp->numa_node < 0)
+		return;
+	cpu = sched_getcpu();
+	if (cpu < 0)
+		return;
+	if (crdp->cpu_affinity >= 0) {
+		if (cpu == crdp->cpu_affinity)
+			return;
+	} else {
+		if (call_rcu_cpu_node(cpu) == crdp->numa_node)
+			return;
+	}
+	switch (crdp->affinity_fallback) {
+	case CALL_RCU_AFFINITY_TARGET:
+		break;
+	case CALL_RCU_AFFINITY_INHERITED:
+		if (--crdp->rebalance_retry > 0)
+			return;
+		break;
+	default:
+		if (call_rcu_cpu_node(cpu) == crdp->affinity_fallback
+				&& --crdp->rebalance_retry > 0)
+			return;
+		break;
+	}
+	(void) set_thread_cpu_affinity(crdp);
+}
+
+static int call_rcu_empty(struct call_rcu_data *crdp)
+{
+	return &crdp->cbs.head == _CMM_LOAD_SHARED(crdp->cbs.tail);
+}
+
+/* Whether the queue length reached the backpressure high watermark. */
+static int call_rcu_over_watermark(struct call_rcu_data *crdp)
+{
+	unsigned long high_watermark = CMM_LOAD_SHARED(crdp->high_watermark);
+
+	return high_watermark && uatomic_read(&crdp->qlen) >= high_watermark;
+}
+
+/*
+ * Whether the call_rcu thread should stop waiting within its batching
+ * delay: queue length threshold reached, or stop requested.
+ */
+static int call_rcu_batch_ready(struct call_rcu_data *crdp)
+{
+	unsigned long threshold = CMM_LOAD_SHARED(crdp->qlen_threshold);
+
+	if (threshold && uatomic_read(&crdp->qlen) >= threshold)
+		return 1;
+	if (call_rcu_over_watermark(crdp))
+		return 1;
+	return !!(uatomic_read(&crdp->flags) & URCU_CALL_RCU_STOP);
+}
+
+/* Wait for callbacks to be queued, or for a stop request. */
 static void call_rcu_wait(struct call_rcu_data *crdp)
 {
-	/* Read call_rcu list before read futex */
+	uatomic_set(&crdp->futex, -1);
+	/* Write futex before reading call_rcu list and flags */
 	cmm_smp_mb();
-	if (uatomic_read(&crdp->futex) == -1)
+	while (call_rcu_empty(crdp)
+			&& !(uatomic_read(&crdp->flags) & URCU_CALL_RCU_STOP)
+			&& uatomic_read(&crdp->futex) == -1)
 		futex_async(&crdp->futex, FUTEX_WAIT, -1,
 		      NULL, NULL, 0);
+	uatomic_set(&crdp->futex, 0);
+}
+
+/*
+ * Let callbacks accumulate for the batching delay, unless the queue
+ * length threshold is reached first.
+ */
+static void call_rcu_wait_batch(struct call_rcu_data *crdp)
+{
+	unsigned long delay_us = CMM_LOAD_SHARED(crdp->batch_delay_us);
+	struct timespec timeout;
+
+	if (!delay_us)
+		return;
+	timeout.tv_sec = delay_us / 1000000;
+	timeout.tv_nsec = (delay_us % 1000000) * 1000;
+	uatomic_set(&crdp->futex, CALL_RCU_FUTEX_BATCH);
+	/* Write futex before reading qlen and flags */
+	cmm_smp_mb();
+	if (!call_rcu_batch_ready(crdp))
+		futex_async(&crdp->futex, FUTEX_WAIT, CALL_RCU_FUTEX_BATCH,
+		      &timeout, NULL, 0);
+	uatomic_set(&crdp->futex, 0);
+}
+
+/*
+ * Real-time call_rcu threads are never woken up by call_rcu(): sleep
+ * for the batching delay by periods of at most 1 ms, so the queue
+ * length threshold is noticed.
+ */
+static void call_rcu_rt_wait_batch(struct call_rcu_data *crdp)
+{
+	unsigned long delay_us = CMM_LOAD_SHARED(crdp->batch_delay_us);
+	struct timespec ts;
+
+	while (delay_us && !call_rcu_batch_ready(crdp)) {
+		unsigned long us = delay_us < 1000 ? delay_us : 1000;
+
+		ts.tv_sec = 0;
+		ts.tv_nsec = us * 1000;
+		(void) nanosleep(&ts, NULL);
+		delay_us -= us;
+	}
 }
 
 static void call_rcu_wake_up(struct call_rcu_data *crdp)
 {
-	/* Write to call_rcu list before reading/writing futex */
+	int32_t futex;
+
+	/* Write to call_rcu list and qlen before reading/writing futex */
 	cmm_smp_mb();
-	if (caa_unlikely(uatomic_read(&crdp->futex) == -1)) {
+	futex = uatomic_read(&crdp->futex);
+	if (caa_unlikely(futex == -1)
+			|| (futex == CALL_RCU_FUTEX_BATCH
+				&& call_rcu_batch_ready(crdp))) {
 		uatomic_set(&crdp->futex, 0);
 		futex_async(&crdp->futex, FUTEX_WAKE, 1,
 		      NULL, NULL, 0);
 	}
 }
 
+/* Wake up call_rcu() callers blocked on crdp until a batch completes. */
+static void __call_rcu_backpressure_wake_up(struct call_rcu_data *crdp)
+{
+	struct urcu_waiters waiters;
+
+	uatomic_inc(&crdp->batch_seq);
+	/* Increment batch sequence before reading waiters */
+	cmm_smp_mb();
+	if (CMM_LOAD_SHARED(crdp->backpressure_waiters.head)
+			== URCU_WAIT_QUEUE_END)
+		return;
+	urcu_move_waiters(&waiters, &crdp->backpressure_waiters);
+	urcu_wake_all_waiters(&waiters);
+}
+
+/*
+ * Called by the call_rcu thread after each batch. Callers only block
+ * while a high watermark is set: clearing it wakes them up.
+ */
+static void call_rcu_backpressure_wake_up(struct call_rcu_data *crdp)
+{
+	if (!CMM_LOAD_SHARED(crdp->high_watermark))
+		return;
+	__call_rcu_backpressure_wake_up(crdp);
+}
+
+/* Wait for a batch to complete after batch sequence "seq" was read. */
+static void call_rcu_backpressure_wait(struct call_rcu_data *crdp,
+				       unsigned long seq)
+{
+	DEFINE_URCU_WAIT_NODE(wait, URCU_WAIT_WAITING);
+	struct urcu_waiters waiters;
+
+	urcu_wait_add(&crdp->backpressure_waiters, &wait);
+	/*
+	 * A batch completed before we were added: the call_rcu thread
+	 * may not find us, wake up waiters ourself.
+	 */
+	if (uatomic_read(&crdp->batch_seq) != seq) {
+		urcu_move_waiters(&waiters, &crdp->backpressure_waiters);
+		urcu_wake_all_waiters(&waiters);
+	}
+	urcu_adaptative_busy_wait(&wait);
+}
+
+/*
+ * Wait for a concurrent call_rcu() to link the node following "*nextp"
+ * and return it.
+ */
+static struct cds_wfq_node *call_rcu_sync_next(struct cds_wfq_node **nextp)
+{
+	struct cds_wfq_node *next;
+	int attempt = 0;
+
+	while ((next = _CMM_LOAD_SHARED(*nextp)) == NULL) {
+		if (++attempt >= CALL_RCU_ADAPT_ATTEMPTS) {
+			poll(NULL, 0, CALL_RCU_WAIT);
+			attempt = 0;
+		} else {
+			caa_cpu_relax();
+		}
+	}
+	return next;
+}
+
+static void call_rcu_completion_wait(struct call_rcu_completion *completion)
+{
+	/* Read completion barrier count before read futex */
+	cmm_smp_mb();
+	if (uatomic_read(&completion->futex) == -1)
+		futex_async(&completion->futex, FUTEX_WAIT, -1,
+		      NULL, NULL, 0);
+}
+
+static void call_rcu_completion_wake_up(struct call_rcu_completion *completion)
+{
+	/* Write to completion barrier count before reading/writing futex */
+	cmm_smp_mb();
+	if (caa_unlikely(uatomic_read(&completion->futex) == -1)) {
+		uatomic_set(&completion->futex, 0);
+		futex_async(&completion->futex, FUTEX_WAKE, 1,
+		      NULL, NULL, 0);
+	}
+}
+
 /* This is the code run by each call_rcu thread. */
 
 static void *call_rcu_thread(void *arg)
 {
 	unsigned long cbcount;
-	struct cds_wfq_node *cbs;
+	struct cds_wfq_node *cbs, *next;
 	struct cds_wfq_node **cbs_tail;
 	struct call_rcu_data *crdp = (struct call_rcu_data *)arg;
 	struct rcu_head *rhp;
@@ -237,54 +667,49 @@ static void *call_rcu_thread(void *arg)
 	rcu_register_thread();
 
 	URCU_TLS(thread_call_rcu_data) = crdp;
-	if (!rt) {
-		uatomic_dec(&crdp->futex);
-		/* Decrement futex before reading call_rcu list */
-		cmm_smp_mb();
-	}
 	for (;;) {
-		if (&crdp->cbs.head != _CMM_LOAD_SHARED(crdp->cbs.tail)) {
-			while ((cbs = _CMM_LOAD_SHARED(crdp->cbs.head)) == NULL)
-				poll(NULL, 0, 1);
+		if (!call_rcu_empty(crdp)) {
+			cbs = call_rcu_sync_next(&crdp->cbs.head);
 			_CMM_STORE_SHARED(crdp->cbs.head, NULL);
 			cbs_tail = (struct cds_wfq_node **)
 				uatomic_xchg(&crdp->cbs.tail, &crdp->cbs.head);
+			urcu_trace(RCU_TRACE_CALL_RCU_BATCH_BEGIN,
+				uatomic_read(&crdp->qlen));
+			/*
+			 * Concurrent synchronize_rcu() calls from the
+			 * call_rcu threads of this flavor share a single
+			 * grace period.
+			 */
 			synchronize_rcu();
 			cbcount = 0;
 			do {
-				while (cbs->next == NULL &&
-				       &cbs->next != cbs_tail)
-				       	poll(NULL, 0, 1);
+				if (&cbs->next != cbs_tail)
+					next = call_rcu_sync_next(&cbs->next);
+				else
+					next = NULL;
 				if (cbs == &crdp->cbs.dummy) {
-					cbs = cbs->next;
+					cbs = next;
 					continue;
 				}
 				rhp = (struct rcu_head *)cbs;
-				cbs = cbs->next;
+				cbs = next;
 				rhp->func(rhp);
 				cbcount++;
 			} while (cbs != NULL);
 			uatomic_sub(&crdp->qlen, cbcount);
+			CMM_STORE_SHARED(crdp->invoked, crdp->invoked + cbcount);
+			urcu_trace(RCU_TRACE_CALL_RCU_BATCH_END, cbcount);
+			call_rcu_backpressure_wake_up(crdp);
 		}
+		call_rcu_rebalance(crdp);
 		if (uatomic_read(&crdp->flags) & URCU_CALL_RCU_STOP)
 			break;
 		rcu_thread_offline();
 		if (!rt) {
-			if (&crdp->cbs.head
-			    == _CMM_LOAD_SHARED(crdp->cbs.tail)) {
-				call_rcu_wait(crdp);
-				poll(NULL, 0, 10);
-				uatomic_dec(&crdp->futex);
-				/*
-				 * Decrement futex before reading
-				 * call_rcu list.
-				 */
-				cmm_smp_mb();
-			} else {
-				poll(NULL, 0, 10);
-			}
+			call_rcu_wait(crdp);
+			call_rcu_wait_batch(crdp);
 		} else {
-			poll(NULL, 0, 10);
+			call_rcu_rt_wait_batch(crdp);
 		}
 		rcu_thread_online();
 	}
@@ -308,7 +733,8 @@ static void *call_rcu_thread(void *arg)
 
 static void call_rcu_data_init(struct call_rcu_data **crdpp,
 			       unsigned long flags,
-			       int cpu_affinity)
+			       int cpu_affinity,
+			       int numa_node)
 {
 	struct call_rcu_data *crdp;
 	int ret;
@@ -321,8 +747,14 @@ static void call_rcu_data_init(struct call_rcu_data **crdpp,
 	crdp->qlen = 0;
 	crdp->futex = 0;
 	crdp->flags = flags;
+	crdp->batch_delay_us = URCU_CALL_RCU_BATCH_DELAY_US;
+	crdp->qlen_threshold = URCU_CALL_RCU_QLEN_THRESHOLD;
 	cds_list_add(&crdp->list, &call_rcu_data_list);
 	crdp->cpu_affinity = cpu_affinity;
+	crdp->numa_node = numa_node;
+	crdp->affinity_fallback = CALL_RCU_AFFINITY_TARGET;
+	crdp->rebalance_retry = CALL_RCU_REBALANCE_RETRY;
+	crdp->backpressure_waiters.head = URCU_WAIT_QUEUE_END;
 	cmm_smp_mb();  /* Structure initialized before pointer is planted. */
 	*crdpp = crdp;
 	ret = pthread_create(&crdp->tid, NULL, call_rcu_thread, crdp);
@@ -357,6 +789,34 @@ struct call_rcu_data *get_cpu_call_rcu_data(int cpu)
 	return rcu_dereference(pcpu_crdp[cpu]);
 }
 
+/*
+ * Return a pointer to the call_rcu_data structure for the specified
+ * NUMA node, returning NULL if there is none.
+ *
+ * The call to this function and use of the returned call_rcu_data
+ * should be protected by RCU read-side lock.
+ */
+
+struct call_rcu_data *get_node_call_rcu_data(int node)
+{
+	struct call_rcu_node_map *map;
+
+	map = rcu_dereference(call_rcu_node_map);
+	if (map == NULL || node < 0 || map->nr_nodes <= node)
+		return NULL;
+	return rcu_dereference(map->crdp[node]);
+}
+
+/*
+ * Return the call_rcu_data structure of the NUMA node of the specified
+ * CPU, returning NULL if there is none.
+ */
+
+static struct call_rcu_data *get_cpu_node_call_rcu_data(int cpu)
+{
+	return get_node_call_rcu_data(call_rcu_cpu_node(cpu));
+}
+
 /*
  * Return the tid corresponding to the call_rcu thread whose
  * call_rcu_data structure is specified.
@@ -369,14 +829,19 @@ pthread_t get_call_rcu_thread(struct call_rcu_data *crdp)
 
 /*
  * Create a call_rcu_data structure (with thread) and return a pointer.
+ * Caller must hold call_rcu_mutex.
  */
 
 static struct call_rcu_data *__create_call_rcu_data(unsigned long flags,
-						    int cpu_affinity)
+						    int cpu_affinity,
+						    int numa_node)
 {
 	struct call_rcu_data *crdp;
 
-	call_rcu_data_init(&crdp, flags, cpu_affinity);
+	/* The node map lets the thread fall back on the CPU's node. */
+	if (cpu_affinity >= 0)
+		alloc_node_call_rcu_data();
+	call_rcu_data_init(&crdp, flags, cpu_affinity, numa_node);
 	return crdp;
 }
 
@@ -386,7 +851,7 @@ struct call_rcu_data *create_call_rcu_data(unsigned long flags,
 	struct call_rcu_data *crdp;
 
 	call_rcu_lock(&call_rcu_mutex);
-	crdp = __create_call_rcu_data(flags, cpu_affinity);
+	crdp = __create_call_rcu_data(flags, cpu_affinity, -1);
 	call_rcu_unlock(&call_rcu_mutex);
 	return crdp;
 }
@@ -437,6 +902,155 @@ int set_cpu_call_rcu_data(int cpu, struct call_rcu_data *crdp)
 	return 0;
 }
 
+/*
+ * Set the batching delay (in microseconds) of the call_rcu thread
+ * associated with the specified call_rcu_data structure, and the queue
+ * length cutting this delay short (0 to disable). A zero delay starts
+ * a grace period as soon as callbacks are queued. Takes effect at the
+ * next batching delay.
+ */
+
+int set_call_rcu_data_batching(struct call_rcu_data *crdp,
+			       unsigned long delay_us,
+			       unsigned long qlen_threshold)
+{
+	if (crdp == NULL) {
+		errno = EINVAL;
+		return -EINVAL;
+	}
+	CMM_STORE_SHARED(crdp->batch_delay_us, delay_us);
+	CMM_STORE_SHARED(crdp->qlen_threshold, qlen_threshold);
+	return 0;
+}
+
+/*
+ * Set the queue length beyond which call_rcu() pushes back on callers
+ * using the specified call_rcu_data structure (0 to disable), and how.
+ */
+
+int set_call_rcu_data_backpressure(struct call_rcu_data *crdp,
+				   unsigned long high_watermark,
+				   int policy)
+{
+	if (crdp == NULL) {
+		errno = EINVAL;
+		return -EINVAL;
+	}
+	switch (policy) {
+	case URCU_CALL_RCU_BACKPRESSURE_EXPEDITE:
+	case URCU_CALL_RCU_BACKPRESSURE_HELP:
+	case URCU_CALL_RCU_BACKPRESSURE_BLOCK:
+		break;
+	default:
+		errno = EINVAL;
+		return -EINVAL;
+	}
+	CMM_STORE_SHARED(crdp->backpressure, policy);
+	CMM_STORE_SHARED(crdp->high_watermark, high_watermark);
+	/* Store high watermark before waking up blocked callers */
+	cmm_smp_mb();
+	__call_rcu_backpressure_wake_up(crdp);
+	return 0;
+}
+
+/*
+ * Get the number of times each backpressure policy was applied to
+ * call_rcu() callers using the specified call_rcu_data structure.
+ */
+
+int get_call_rcu_data_backpressure_stats(struct call_rcu_data *crdp,
+		struct call_rcu_backpressure_stats *stats)
+{
+	if (crdp == NULL || stats == NULL) {
+		errno = EINVAL;
+		return -EINVAL;
+	}
+	stats->expedite = uatomic_read(&crdp->backpressure_stats.expedite);
+	stats->help = uatomic_read(&crdp->backpressure_stats.help);
+	stats->block = uatomic_read(&crdp->backpressure_stats.block);
+	return 0;
+}
+
+/*
+ * Get the number of callbacks queued on the specified call_rcu_data
+ * structure and not invoked yet.
+ */
+
+unsigned long get_call_rcu_data_qlen(struct call_rcu_data *crdp)
+{
+	if (crdp == NULL)
+		return 0;
+	return uatomic_read(&crdp->qlen);
+}
+
+/*
+ * Sum the queue lengths and invoked callbacks of all call_rcu_data
+ * structures, for rcu_get_stats().
+ */
+
+static void call_rcu_get_stats(struct rcu_stats *stats)
+{
+	struct call_rcu_data *crdp;
+
+	stats->call_rcu_data_count = 0;
+	stats->call_rcu_qlen = 0;
+	call_rcu_lock(&call_rcu_mutex);
+	stats->call_rcu_invoked = call_rcu_freed_invoked;
+	cds_list_for_each_entry(crdp, &call_rcu_data_list, list) {
+		stats->call_rcu_data_count++;
+		stats->call_rcu_qlen += uatomic_read(&crdp->qlen);
+		stats->call_rcu_invoked += CMM_LOAD_SHARED(crdp->invoked);
+	}
+	call_rcu_unlock(&call_rcu_mutex);
+}
+
+/*
+ * Set the specified NUMA node to use the specified call_rcu_data
+ * structure, for CPUs of this node without call_rcu_data of their own.
+ * Same rules as set_cpu_call_rcu_data() apply.
+ */
+
+int set_node_call_rcu_data(int node, struct call_rcu_data *crdp)
+{
+	struct call_rcu_node_map *map;
+	static int warned = 0;
+
+	call_rcu_lock(&call_rcu_mutex);
+	alloc_node_call_rcu_data();
+	if (maxcpus <= 0) {
+		call_rcu_unlock(&call_rcu_mutex);
+		errno = EINVAL;
+		return -EINVAL;
+	}
+
+	map = call_rcu_node_map;
+	if (map == NULL) {
+		call_rcu_unlock(&call_rcu_mutex);
+		errno = ENOMEM;
+		return -ENOMEM;
+	}
+
+	if (node < 0 || map->nr_nodes <= node) {
+		if (!warned) {
+			fprintf(stderr, "[error] liburcu: set node # out of range\n");
+			warned = 1;
+		}
+		call_rcu_unlock(&call_rcu_mutex);
+		errno = EINVAL;
+		return -EINVAL;
+	}
+
+	if (map->crdp[node] != NULL && crdp != NULL) {
+		call_rcu_unlock(&call_rcu_mutex);
+		errno = EEXIST;
+		return -EEXIST;
+	}
+
+	rcu_set_pointer(&map->crdp[node], crdp);
+	call_rcu_unlock(&call_rcu_mutex);
+	return 0;
+}
+
 /*
  * Return a pointer to the default call_rcu_data structure, creating
  * one if need be.  Because we never free call_rcu_data structures,
@@ -452,7 +1066,7 @@ struct call_rcu_data *get_default_call_rcu_data(void)
 		call_rcu_unlock(&call_rcu_mutex);
 		return default_call_rcu_data;
 	}
-	call_rcu_data_init(&default_call_rcu_data, 0, -1);
+	call_rcu_data_init(&default_call_rcu_data, 0, -1, -1);
 	call_rcu_unlock(&call_rcu_mutex);
 	return default_call_rcu_data;
 }
@@ -461,9 +1075,10 @@ struct call_rcu_data *get_default_call_rcu_data(void)
  * Return the call_rcu_data structure that applies to the currently
  * running thread.  Any call_rcu_data structure assigned specifically
  * to this thread has first priority, followed by any call_rcu_data
- * structure assigned to the CPU on which the thread is running,
- * followed by the default call_rcu_data structure.  If there is not
- * yet a default call_rcu_data structure, one will be created.
+ * structure assigned to the CPU on which the thread is running, then
+ * by any call_rcu_data structure assigned to the NUMA node of this
+ * CPU, followed by the default call_rcu_data structure.  If there is
+ * not yet a default call_rcu_data structure, one will be created.
  *
  * Calls to this function and use of the returned call_rcu_data should
  * be protected by RCU read-side lock.
@@ -476,7 +1091,12 @@ struct call_rcu_data *get_call_rcu_data(void)
 		return URCU_TLS(thread_call_rcu_data);
 
 	if (maxcpus > 0) {
-		crd = get_cpu_call_rcu_data(sched_getcpu());
+		int cpu = sched_getcpu();
+
+		crd = get_cpu_call_rcu_data(cpu);
+		if (crd)
+			return crd;
+		crd = get_cpu_node_call_rcu_data(cpu);
 		if (crd)
 			return crd;
 	}
@@ -540,7 +1160,7 @@ int create_all_cpu_call_rcu_data(unsigned long flags)
 			call_rcu_unlock(&call_rcu_mutex);
 			continue;
 		}
-		crdp = __create_call_rcu_data(flags, i);
+		crdp = __create_call_rcu_data(flags, i, -1);
 		if (crdp == NULL) {
 			call_rcu_unlock(&call_rcu_mutex);
 			errno = ENOMEM;
@@ -560,6 +1180,62 @@ int create_all_cpu_call_rcu_data(unsigned long flags)
 	return 0;
 }
 
+/*
+ * Create a separate call_rcu thread for each NUMA node having CPUs,
+ * with affinity to the CPUs of this node. Callbacks queued from CPUs
+ * without call_rcu thread of their own are executed, and their memory
+ * freed, on the node where call_rcu() was invoked. Should be paired
+ * with free_all_node_call_rcu_data() to teardown these call_rcu worker
+ * threads.
+ */
+
+int create_all_node_call_rcu_data(unsigned long flags)
+{
+	struct call_rcu_node_map *map;
+	struct call_rcu_data *crdp;
+	long node, cpu;
+	int ret;
+
+	call_rcu_lock(&call_rcu_mutex);
+	alloc_node_call_rcu_data();
+	call_rcu_unlock(&call_rcu_mutex);
+	if (maxcpus <= 0) {
+		errno = EINVAL;
+		return -EINVAL;
+	}
+	map = CMM_LOAD_SHARED(call_rcu_node_map);
+	if (map == NULL) {
+		errno = ENOMEM;
+		return -ENOMEM;
+	}
+	for (node = 0; node < map->nr_nodes; node++) {
+		/* Skip nodes without CPUs. */
+		for (cpu = 0; cpu < maxcpus; cpu++) {
+			if (map->cpu_node[cpu] == node)
+				break;
+		}
+		if (cpu == maxcpus)
+			continue;
+		call_rcu_lock(&call_rcu_mutex);
+		if (get_node_call_rcu_data(node)) {
+			call_rcu_unlock(&call_rcu_mutex);
+			continue;
+		}
+		crdp = __create_call_rcu_data(flags, -1, node);
+		call_rcu_unlock(&call_rcu_mutex);
+		if ((ret = set_node_call_rcu_data(node, crdp)) != 0) {
+			call_rcu_data_free(crdp);
+
+			/* it has been created by other thread */
+			if (ret == -EEXIST)
+				continue;
+
+			return ret;
+		}
+	}
+	return 0;
+}
+
 /*
  * Wake up the call_rcu thread corresponding to the specified
  * call_rcu_data structure.
@@ -570,6 +1246,23 @@ static void wake_call_rcu_thread(struct call_rcu_data *crdp)
 		call_rcu_wake_up(crdp);
 }
 
+/*
+ * Enqueue a callback on the specified call_rcu_data structure.
+ */
+static void _call_rcu(struct rcu_head *head,
+		      void (*func)(struct rcu_head *head),
+		      struct call_rcu_data *crdp)
+{
+	unsigned long qlen;
+
+	cds_wfq_node_init(&head->next);
+	head->func = func;
+	cds_wfq_enqueue(&crdp->cbs, &head->next);
+	qlen = uatomic_add_return(&crdp->qlen, 1);
+	urcu_trace(RCU_TRACE_CALL_RCU, qlen);
+	wake_call_rcu_thread(crdp);
+}
+
 /*
  * Schedule a function to be invoked after a following grace period.
  * This is the only function that must be called -- the others are
@@ -585,19 +1278,99 @@ static void wake_call_rcu_thread(struct call_rcu_data *crdp)
  * call_rcu must be called by registered RCU read-side threads.
  */
 
+/*
+ * Whether call_rcu() is invoked outside of RCU read-side critical
+ * sections. QSBR read-side critical sections do not nest: an online
+ * QSBR thread may hold references to RCU protected data anywhere, so
+ * there is nothing to check. Going offline would end them.
+ */
+static int call_rcu_can_wait(void)
+{
+#ifdef _URCU_QSBR_H
+	return 1;
+#else
+	return !_rcu_read_ongoing();
+#endif
+}
+
+/*
+ * Slow path of call_rcu(), taken when the queue length of the
+ * call_rcu_data structure reached its high watermark. Called outside
+ * of the RCU read-side critical section protecting the call_rcu_data.
+ *
+ * The help and block policies need to wait for grace periods, which
+ * cannot be done within RCU read-side critical sections, nor from the
+ * call_rcu thread of the structure: they fall back to expedite there.
+ * For QSBR, they make call_rcu() a quiescent state.
+ */
+static void call_rcu_backpressure(struct rcu_head *head,
+				  void (*func)(struct rcu_head *head))
+{
+	struct call_rcu_data *crdp;
+	unsigned long seq;
+	int was_online, can_wait, policy, blocked = 0;
+
+	can_wait = call_rcu_can_wait();
+	for (;;) {
+		rcu_read_lock();
+		crdp = get_call_rcu_data();
+		seq = uatomic_read(&crdp->batch_seq);
+		/* Read batch sequence before queue length */
+		cmm_smp_mb();
+		if (!call_rcu_over_watermark(crdp))
+			break;
+		policy = CMM_LOAD_SHARED(crdp->backpressure);
+		if (!can_wait || pthread_equal(pthread_self(), crdp->tid))
+			policy = URCU_CALL_RCU_BACKPRESSURE_EXPEDITE;
+		switch (policy) {
+		case URCU_CALL_RCU_BACKPRESSURE_HELP:
+			uatomic_inc(&crdp->backpressure_stats.help);
+			rcu_read_unlock();
+			/* Run our callback ourself rather than queuing it. */
+			synchronize_rcu();
+			func(head);
+			return;
+		case URCU_CALL_RCU_BACKPRESSURE_BLOCK:
+			if (!blocked) {
+				uatomic_inc(&crdp->backpressure_stats.block);
+				blocked = 1;
+			}
+			uatomic_inc(&crdp->backpressure_nr_blocked);
+			rcu_read_unlock();
+			/* Put in offline state in QSBR. */
+			was_online = _rcu_read_ongoing();
+			if (was_online)
+				rcu_thread_offline();
+			call_rcu_backpressure_wait(crdp, seq);
+			if (was_online)
+				rcu_thread_online();
+			uatomic_dec(&crdp->backpressure_nr_blocked);
+			continue;
+		default:
+			/* Queue length cuts the batching delay short. */
+			uatomic_inc(&crdp->backpressure_stats.expedite);
+			goto enqueue;
+		}
+	}
+enqueue:
+	_call_rcu(head, func, crdp);
+	rcu_read_unlock();
+}
+
 void call_rcu(struct rcu_head *head,
 	      void (*func)(struct rcu_head *head))
 {
 	struct call_rcu_data *crdp;
 
-	cds_wfq_node_init(&head->next);
-	head->func = func;
 	/* Holding rcu read-side lock across use of per-cpu crdp */
 	rcu_read_lock();
 	crdp = get_call_rcu_data();
-	cds_wfq_enqueue(&crdp->cbs, &head->next);
-	uatomic_inc(&crdp->qlen);
-	wake_call_rcu_thread(crdp);
+	if (caa_unlikely(call_rcu_over_watermark(crdp))) {
+		rcu_read_unlock();
+		call_rcu_backpressure(head, func);
+		return;
+	}
+	_call_rcu(head, func, crdp);
 	rcu_read_unlock();
 }
 
@@ -638,26 +1411,49 @@ void call_rcu_data_free(struct call_rcu_data *crdp)
 		while ((uatomic_read(&crdp->flags) & URCU_CALL_RCU_STOPPED) == 0)
 			poll(NULL, 0, 1);
 	}
+	/*
+	 * Unlink before moving the leftover callbacks, so a concurrent
+	 * rcu_barrier() either sees this structure and queues its barrier
+	 * callback before the move, or does not see it at all.
+	 */
+	call_rcu_lock(&call_rcu_mutex);
+	cds_list_del(&crdp->list);
+	call_rcu_freed_invoked += crdp->invoked;
+	call_rcu_unlock(&call_rcu_mutex);
+
 	if (&crdp->cbs.head != _CMM_LOAD_SHARED(crdp->cbs.tail)) {
 		while ((cbs = _CMM_LOAD_SHARED(crdp->cbs.head)) == NULL)
 			poll(NULL, 0, 1);
 		_CMM_STORE_SHARED(crdp->cbs.head, NULL);
 		cbs_tail = (struct cds_wfq_node **)
 			uatomic_xchg(&crdp->cbs.tail, &crdp->cbs.head);
+		/* The dummy node is freed along with crdp: skip it. */
+		if (cbs == &crdp->cbs.dummy) {
+			if (&cbs->next == cbs_tail)
+				goto free;
+			while (_CMM_LOAD_SHARED(cbs->next) == NULL)
+				poll(NULL, 0, 1);
+			cbs = cbs->next;
+		}
 		/* Create default call rcu data if need be */
 		(void) get_default_call_rcu_data();
 		cbs_endprev = (struct cds_wfq_node **)
-			uatomic_xchg(&default_call_rcu_data, cbs_tail);
-		*cbs_endprev = cbs;
+			uatomic_xchg(&default_call_rcu_data->cbs.tail,
+				     cbs_tail);
+		_CMM_STORE_SHARED(*cbs_endprev, cbs);
 		uatomic_add(&default_call_rcu_data->qlen,
 			    uatomic_read(&crdp->qlen));
 		wake_call_rcu_thread(default_call_rcu_data);
 	}
 
-	call_rcu_lock(&call_rcu_mutex);
-	cds_list_del(&crdp->list);
-	call_rcu_unlock(&call_rcu_mutex);
-
+free:
+	/*
+	 * Let callers blocked on this structure check the default one,
+	 * and wait for them to stop using it.
+	 */
+	__call_rcu_backpressure_wake_up(crdp);
+	while (uatomic_read(&crdp->backpressure_nr_blocked))
+		poll(NULL, 0, 1);
 	free(crdp);
 }
 
@@ -701,6 +1497,144 @@ void free_all_cpu_call_rcu_data(void)
 	free(crdp);
 }
 
+static void free_completion(struct urcu_ref *ref)
+{
+	struct call_rcu_completion *completion;
+
+	completion = caa_container_of(ref, struct call_rcu_completion, ref);
+	free(completion);
+}
+
+static void _rcu_barrier_complete(struct rcu_head *head)
+{
+	struct call_rcu_completion_work *work;
+	struct call_rcu_completion *completion;
+
+	work = caa_container_of(head, struct call_rcu_completion_work, head);
+	completion = work->completion;
+	if (!uatomic_sub_return(&completion->barrier_count, 1))
+		call_rcu_completion_wake_up(completion);
+	urcu_ref_put(&completion->ref, free_completion);
+	free(work);
+}
+
+/*
+ * Wait for all in-flight call_rcu callbacks to complete execution.
+ * A barrier callback is queued on each call_rcu_data structure
+ * (default, per-CPU and per-thread). call_rcu_mutex is only held while
+ * queuing them, not while waiting for the callbacks to execute.
+ *
+ * Must not be called from a call_rcu callback, nor from within a RCU
+ * read-side critical section. QSBR threads are put offline while
+ * waiting.
+ */
+void rcu_barrier(void)
+{
+	struct call_rcu_data *crdp;
+	struct call_rcu_completion *completion;
+	int count = 0;
+	int was_online;
+
+	/* Put in offline state in QSBR. */
+	was_online = _rcu_read_ongoing();
+	if (was_online)
+		rcu_thread_offline();
+	/*
+	 * Calling a rcu_barrier() within a RCU read-side critical
+	 * section is an error.
+	 */
+	if (_rcu_read_ongoing()) {
+		static int warned = 0;
+
+		if (!warned) {
+			fprintf(stderr, "[error] liburcu: rcu_barrier() called from within RCU read-side critical section.\n");
+		}
+		warned = 1;
+		goto online;
+	}
+
+	completion = calloc(1, sizeof(*completion));
+	if (!completion)
+		urcu_die(errno);
+
+	call_rcu_lock(&call_rcu_mutex);
+	cds_list_for_each_entry(crdp, &call_rcu_data_list, list)
+		count++;
+
+	/* Referenced by rcu_barrier() and each call_rcu thread. */
+	urcu_ref_set(&completion->ref, count + 1);
+	completion->barrier_count = count;
+
+	cds_list_for_each_entry(crdp, &call_rcu_data_list, list) {
+		struct call_rcu_completion_work *work;
+
+		work = calloc(1, sizeof(*work));
+		if (!work)
+			urcu_die(errno);
+		work->completion = completion;
+		_call_rcu(&work->head, _rcu_barrier_complete, crdp);
+	}
+	call_rcu_unlock(&call_rcu_mutex);
+
+	/* Wait for them */
+	for (;;) {
+		uatomic_dec(&completion->futex);
+		/* Decrement futex before reading barrier_count */
+		cmm_smp_mb();
+		if (!uatomic_read(&completion->barrier_count))
+			break;
+		call_rcu_completion_wait(completion);
+	}
+
+	urcu_ref_put(&completion->ref, free_completion);
+
+online:
+	if (was_online)
+		rcu_thread_online();
+}
+
+/*
+ * Clean up all the per-node call_rcu threads.
+ */
+void free_all_node_call_rcu_data(void)
+{
+	struct call_rcu_node_map *map;
+	struct call_rcu_data **crdp;
+	long node;
+	static int warned = 0;
+
+	map = CMM_LOAD_SHARED(call_rcu_node_map);
+	if (map == NULL)
+		return;
+
+	crdp = malloc(sizeof(*crdp) * map->nr_nodes);
+	if (!crdp) {
+		if (!warned) {
+			fprintf(stderr, "[error] liburcu: unable to allocate per-node pointer array\n");
+		}
+		warned = 1;
+		return;
+	}
+
+	for (node = 0; node < map->nr_nodes; node++) {
+		crdp[node] = get_node_call_rcu_data(node);
+		if (crdp[node] == NULL)
+			continue;
+		set_node_call_rcu_data(node, NULL);
+	}
+	/*
+	 * Wait for call_rcu sites acting as RCU readers of the
+	 * call_rcu_data to become quiescent.
+	 */
+	synchronize_rcu();
+	for (node = 0; node < map->nr_nodes; node++) {
+		if (crdp[node] == NULL)
+			continue;
+		call_rcu_data_free(crdp[node]);
+	}
+	free(crdp);
+}
+
 /*
  * Acquire the call_rcu_mutex in order to ensure that the child sees
  * all of the call_rcu() data structures in a consistent state.
@@ -748,6 +1682,8 @@ void call_rcu_after_fork_child(void)
 	maxcpus_reset();
 	free(per_cpu_call_rcu_data);
 	rcu_set_pointer(&per_cpu_call_rcu_data, NULL);
+	free(call_rcu_node_map);
+	rcu_set_pointer(&call_rcu_node_map, NULL);
 	URCU_TLS(thread_call_rcu_data) = NULL;
 
 	/* Dispose of all of the rest of the call_rcu_data structures. */
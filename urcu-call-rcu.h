@@ -49,6 +49,23 @@ struct call_rcu_data;
 #define URCU_CALL_RCU_STOP	0x4
 #define URCU_CALL_RCU_STOPPED	0x8
 
+/*
+ * Backpressure policies, applied to call_rcu() callers once the queue
+ * length reaches the high watermark.
+ */
+
+#define URCU_CALL_RCU_BACKPRESSURE_EXPEDITE	0 /* Start GP without delay. */
+#define URCU_CALL_RCU_BACKPRESSURE_HELP		1 /* Run callback inline. */
+#define URCU_CALL_RCU_BACKPRESSURE_BLOCK	2 /* Wait for callbacks. */
+
+/* Number of times each backpressure policy was applied. */
+
+struct call_rcu_backpressure_stats {
+	unsigned long expedite;
+	unsigned long help;
+	unsigned long block;
+};
+
 /*
  * The rcu_head data structure is placed in the structure to be freed
  * via call_rcu().
@@ -76,15 +93,30 @@ void call_rcu_data_free(struct call_rcu_data *crdp);
 
 struct call_rcu_data *get_default_call_rcu_data(void);
 struct call_rcu_data *get_cpu_call_rcu_data(int cpu);
+struct call_rcu_data *get_node_call_rcu_data(int node);
 struct call_rcu_data *get_thread_call_rcu_data(void);
 struct call_rcu_data *get_call_rcu_data(void);
 pthread_t get_call_rcu_thread(struct call_rcu_data *crdp);
 
 void set_thread_call_rcu_data(struct call_rcu_data *crdp);
 int set_cpu_call_rcu_data(int cpu, struct call_rcu_data *crdp);
+int set_node_call_rcu_data(int node, struct call_rcu_data *crdp);
+int set_call_rcu_data_batching(struct call_rcu_data *crdp,
+			       unsigned long delay_us,
+			       unsigned long qlen_threshold);
+int set_call_rcu_data_backpressure(struct call_rcu_data *crdp,
+				   unsigned long high_watermark,
+				   int policy);
+int get_call_rcu_data_backpressure_stats(struct call_rcu_data *crdp,
+		struct call_rcu_backpressure_stats *stats);
+unsigned long get_call_rcu_data_qlen(struct call_rcu_data *crdp);
 
 int create_all_cpu_call_rcu_data(unsigned long flags);
 void free_all_cpu_call_rcu_data(void);
+int create_all_node_call_rcu_data(unsigned long flags);
+void free_all_node_call_rcu_data(void);
+
+void rcu_barrier(void);
 
 void call_rcu_before_fork(void);
 void call_rcu_after_fork_parent(void);
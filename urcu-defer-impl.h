@@ -246,8 +246,10 @@ static void _rcu_defer_barrier_thread(void)
 	num_items = head - URCU_TLS(defer_queue).tail;
 	if (caa_unlikely(!num_items))
 		return;
+	urcu_trace(RCU_TRACE_DEFER_BARRIER_BEGIN, num_items);
 	synchronize_rcu();
 	rcu_defer_barrier_queue(&URCU_TLS(defer_queue), head);
+	urcu_trace(RCU_TRACE_DEFER_BARRIER_END, num_items);
 }
 
 void rcu_defer_barrier_thread(void)
@@ -290,9 +292,11 @@ void rcu_defer_barrier(void)
 		 */
 		goto end;
 	}
+	urcu_trace(RCU_TRACE_DEFER_BARRIER_BEGIN, num_items);
 	synchronize_rcu();
 	cds_list_for_each_entry(index, &registry_defer, list)
 		rcu_defer_barrier_queue(index, index->last_head);
+	urcu_trace(RCU_TRACE_DEFER_BARRIER_END, num_items);
 end:
 	mutex_unlock(&rcu_defer_mutex);
 }
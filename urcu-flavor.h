@@ -40,6 +40,14 @@ struct rcu_flavor_struct {
 	void (*thread_online)(void);
 	void (*register_thread)(void);
 	void (*unregister_thread)(void);
+
+	struct urcu_gp_poll_state (*update_start_poll_synchronize_rcu)(void);
+	int (*update_poll_state_synchronize_rcu)(struct urcu_gp_poll_state state);
+	void (*update_cond_synchronize_rcu)(struct urcu_gp_poll_state state);
+
+	void (*update_barrier)(void);
+
+	void (*update_synchronize_rcu_expedited)(void);
 };
 
 #define DEFINE_RCU_FLAVOR(x)				\
@@ -54,6 +62,11 @@ const struct rcu_flavor_struct x = {			\
 	.thread_online		= rcu_thread_online,	\
 	.register_thread	= rcu_register_thread,	\
 	.unregister_thread	= rcu_unregister_thread,\
+	.update_start_poll_synchronize_rcu = start_poll_synchronize_rcu, \
+	.update_poll_state_synchronize_rcu = poll_state_synchronize_rcu, \
+	.update_cond_synchronize_rcu = cond_synchronize_rcu, \
+	.update_barrier		= rcu_barrier,	\
+	.update_synchronize_rcu_expedited = synchronize_rcu_expedited, \
 }
 
 extern const struct rcu_flavor_struct rcu_flavor;
@@ -0,0 +1,508 @@
+/*
+ * urcu-percpu.c
+ *
+ * Userspace RCU library, per-CPU reader counters version
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#define _GNU_SOURCE
+#define _LGPL_SOURCE
+#include <stdio.h>
+#include <pthread.h>
+#include <signal.h>
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sched.h>
+
+#include "urcu/wfqueue.h"
+#include "urcu/map/urcu-percpu.h"
+#include "urcu/static/urcu-percpu.h"
+#include "urcu-pointer.h"
+#include "urcu/tls-compat.h"
+
+#include "urcu-die.h"
+#include "urcu-wait.h"
+
+/* Do not #define _LGPL_SOURCE to ensure we can emit the wrapper symbols */
+#undef _LGPL_SOURCE
+#include "urcu-percpu.h"
+#define _LGPL_SOURCE
+
+/*
+ * Initial active attempts to check for reader Q.S. before calling futex(),
+ * adapted to the readers at runtime by urcu-spin-impl.h.
+ */
+#define RCU_QS_ACTIVE_ATTEMPTS 100
+
+#define RCU_FLAVOR_NAME	"percpu"
+
+#include "urcu-trace-impl.h"
+#include "urcu-stats-impl.h"
+#include "urcu-spin-impl.h"
+
+void __attribute__((constructor)) rcu_percpu_init(void);
+void __attribute__((destructor)) rcu_exit(void);
+
+/*
+ * rcu_gp_lock ensures mutual exclusion between threads calling
+ * synchronize_rcu().
+ */
+static pthread_mutex_t rcu_gp_lock = PTHREAD_MUTEX_INITIALIZER;
+/*
+ * rcu_init_lock serializes the allocation of the per-CPU counters.
+ */
+static pthread_mutex_t rcu_init_lock = PTHREAD_MUTEX_INITIALIZER;
+
+int has_sys_membarrier;
+#ifdef SYS_membarrier
+/* membarrier(2) command issued by smp_mb_master(). */
+static int membarrier_cmd;
+#endif
+
+int32_t gp_futex;
+
+/*
+ * Global grace period counter. Its low-order bit is the phase counted
+ * by new readers. Written to only by writer with mutex taken. Read by
+ * both writer and readers.
+ */
+unsigned long rcu_gp_ctr;
+
+struct rcu_percpu_ctr *rcu_percpu_ctrs;
+int rcu_percpu_nr_cpus;
+
+/*
+ * Written to only by each individual reader. Read only by the reader.
+ */
+DEFINE_URCU_TLS(struct rcu_reader, rcu_reader);
+
+#ifdef DEBUG_YIELD
+unsigned int yield_active;
+DEFINE_URCU_TLS(unsigned int, rand_yield);
+#endif
+
+/* Fallback counter slot handed to the next thread without a CPU id. */
+static int next_slot;
+
+/*
+ * Grace period sequence number for the polling API. Odd while a grace
+ * period is in progress. Written to only by writer with mutex taken.
+ */
+static unsigned long rcu_gp_seq;
+
+/*
+ * Queue keeping threads awaiting to wait for a grace period. Contains
+ * struct urcu_wait_node objects, allocated on the waiters' stacks.
+ */
+static DEFINE_URCU_WAIT_QUEUE(gp_waiters);
+
+/*
+ * Number of synchronize_rcu_expedited() calls in progress. While
+ * non-zero, grace periods busy-wait for readers instead of sleeping on
+ * gp_futex.
+ */
+static int gp_expedited;
+
+static void mutex_lock(pthread_mutex_t *mutex)
+{
+	int ret;
+
+#ifndef DISTRUST_SIGNALS_EXTREME
+	ret = pthread_mutex_lock(mutex);
+	if (ret)
+		urcu_die(ret);
+#else /* #ifndef DISTRUST_SIGNALS_EXTREME */
+	while ((ret = pthread_mutex_trylock(mutex)) != 0) {
+		if (ret != EBUSY && ret != EINTR)
+			urcu_die(ret);
+		poll(NULL,0,10);
+	}
+#endif /* #else #ifndef DISTRUST_SIGNALS_EXTREME */
+}
+
+static void mutex_unlock(pthread_mutex_t *mutex)
+{
+	int ret;
+
+	ret = pthread_mutex_unlock(mutex);
+	if (ret)
+		urcu_die(ret);
+}
+
+static void smp_mb_master(void)
+{
+#ifdef SYS_membarrier
+	if (caa_likely(has_sys_membarrier)) {
+		if (membarrier(membarrier_cmd, 0))
+			urcu_die(errno);
+		return;
+	}
+#endif
+	cmm_smp_mb();
+}
+
+/*
+ * Sum of the lock or unlock counts of phase "phase" over all CPUs.
+ */
+static unsigned long sum_counts(unsigned long phase, int unlock)
+{
+	unsigned long sum = 0;
+	int cpu;
+
+	for (cpu = 0; cpu < rcu_percpu_nr_cpus; cpu++) {
+		struct rcu_percpu_ctr *ctr = &rcu_percpu_ctrs[cpu];
+
+		if (unlock)
+			sum += CMM_LOAD_SHARED(ctr->rseq[phase].unlock)
+				+ CMM_LOAD_SHARED(ctr->atomic[phase].unlock);
+		else
+			sum += CMM_LOAD_SHARED(ctr->rseq[phase].lock)
+				+ CMM_LOAD_SHARED(ctr->atomic[phase].lock);
+	}
+	return sum;
+}
+
+/*
+ * Returns whether readers may still be within a read-side critical
+ * section counted in phase "phase". Summing the unlock counts before
+ * the lock counts, with a memory barrier pairing with the one of
+ * _rcu_read_lock() in between, ensures that a reader whose unlock is
+ * counted also has its lock counted. The sums can therefore only be
+ * equal when no reader of this phase is left, unless a reader counted
+ * itself in this phase after reading a stale rcu_gp_ctr: there is at
+ * most one such reader per thread, and it entered its critical section
+ * after the start of the grace period.
+ */
+static int readers_active(unsigned long phase)
+{
+	unsigned long unlocks;
+
+	urcu_stats_scanned(rcu_percpu_nr_cpus);
+	unlocks = sum_counts(phase, 1);
+	smp_mb_master();
+	return sum_counts(phase, 0) != unlocks;
+}
+
+/*
+ * Cheap check, without forcing a memory barrier on readers. Only used
+ * to decide whether it is worth calling readers_active().
+ */
+static int readers_maybe_active(unsigned long phase)
+{
+	unsigned long unlocks;
+
+	urcu_stats_scanned(rcu_percpu_nr_cpus);
+	unlocks = sum_counts(phase, 1);
+	cmm_smp_rmb();
+	return sum_counts(phase, 0) != unlocks;
+}
+
+/*
+ * synchronize_rcu() waiting. Single thread.
+ */
+static void wait_gp(void)
+{
+	/* Read reader counters before read futex */
+	smp_mb_master();
+	if (uatomic_read(&gp_futex) == -1) {
+		urcu_stats_sleep();
+		urcu_trace(RCU_TRACE_GP_SLEEP, 0);
+		futex_async(&gp_futex, FUTEX_WAIT, -1,
+		      NULL, NULL, 0);
+		urcu_trace(RCU_TRACE_GP_WAKEUP, 0);
+	}
+}
+
+/*
+ * Wait for the readers counted in phase "phase" to exit their
+ * read-side critical section.
+ */
+static void wait_for_readers(unsigned long phase)
+{
+	struct urcu_spin spin;
+	unsigned int attempts, wait_loops = 0;
+
+	attempts = urcu_spin_begin(&spin);
+	/* Once the busy-wait attempts are exhausted, each loop sleeps. */
+	for (;;) {
+		if (wait_loops < attempts)
+			wait_loops++;
+		if (wait_loops == attempts && uatomic_read(&gp_expedited)) {
+			/*
+			 * Expedited grace period: keep busy-waiting
+			 * instead of sleeping. Readers see gp_futex
+			 * reset, and skip the wakeup.
+			 */
+			uatomic_set(&gp_futex, 0);
+			urcu_spin_discard(&spin);
+			wait_loops = 0;
+		}
+		if (wait_loops == attempts) {
+			uatomic_set(&gp_futex, -1);
+			/* Write futex before read reader counters */
+			smp_mb_master();
+		}
+
+		if ((wait_loops == attempts
+		     || !readers_maybe_active(phase))
+		    && !readers_active(phase)) {
+			if (wait_loops == attempts) {
+				/* Read reader counters before write futex */
+				smp_mb_master();
+				uatomic_set(&gp_futex, 0);
+			}
+			urcu_spin_end(&spin, wait_loops);
+			urcu_trace(RCU_TRACE_GP_PHASE, wait_loops);
+			break;
+		}
+		if (wait_loops == attempts)
+			wait_gp();
+		else
+			caa_cpu_relax();
+	}
+}
+
+static void __synchronize_rcu(int expedited)
+{
+	DEFINE_URCU_WAIT_NODE(wait, URCU_WAIT_WAITING);
+	struct urcu_waiters waiters;
+	unsigned long phase;
+
+	/*
+	 * Add ourself to gp_waiters queue of threads awaiting to wait
+	 * for a grace period. Proceed to perform the grace period only
+	 * if we are the first thread added into the queue.
+	 * The implicit memory barrier before urcu_wait_add()
+	 * orders prior memory accesses of threads put into the wait
+	 * queue before their insertion into the wait queue.
+	 */
+	if (urcu_wait_add(&gp_waiters, &wait) != 0) {
+		/* Not first in queue: will be awakened by another thread. */
+		if (expedited)
+			urcu_busy_wait(&wait);
+		else
+			urcu_adaptative_busy_wait(&wait);
+		/* Order following memory accesses after grace period. */
+		cmm_smp_mb();
+		return;
+	}
+	/* We won't need to wake ourself up */
+	urcu_wait_set_state(&wait, URCU_WAIT_RUNNING);
+
+	mutex_lock(&rcu_gp_lock);
+
+	/*
+	 * Move all waiters into our local queue. They have all been
+	 * queued before we start the grace period, so the grace period
+	 * performed below is also theirs.
+	 */
+	urcu_move_waiters(&waiters, &gp_waiters);
+
+	/*
+	 * Start grace period sequence for the polling API. Ordered before
+	 * the counter update by the following memory barrier.
+	 */
+	CMM_STORE_SHARED(rcu_gp_seq, rcu_gp_seq + 1);
+	urcu_trace(RCU_TRACE_GP_BEGIN, expedited);
+	urcu_stats_gp_begin();
+
+	if (!rcu_percpu_ctrs)
+		goto out;
+
+	/* Write new ptr before reading the reader counters */
+	smp_mb_master();
+
+	/*
+	 * Wait for readers which counted themselves in the inactive
+	 * phase after reading a stale rcu_gp_ctr, so that they do not
+	 * keep the grace period waiting once the phase is switched.
+	 */
+	phase = (rcu_gp_ctr & 1) ^ 1;
+	wait_for_readers(phase);
+
+	/* Finish waiting for the inactive phase before switching phase. */
+	smp_mb_master();
+	CMM_STORE_SHARED(rcu_gp_ctr, rcu_gp_ctr + 1);
+	/* Switch phase before waiting for the previous one. */
+	smp_mb_master();
+
+	/*
+	 * Wait for previous phase to be empty of readers.
+	 */
+	wait_for_readers(phase ^ 1);
+
+	/*
+	 * Finish waiting for reader threads before letting the old ptr
+	 * being freed.
+	 */
+	smp_mb_master();
+out:
+	/* End grace period sequence after reader accesses. */
+	cmm_smp_mb();
+	urcu_stats_gp_end(expedited);
+	CMM_STORE_SHARED(rcu_gp_seq, rcu_gp_seq + 1);
+	urcu_trace(RCU_TRACE_GP_END, expedited);
+	mutex_unlock(&rcu_gp_lock);
+
+	/*
+	 * Wakeup waiters only after we have completed the grace period
+	 * and have ensured the memory barriers at the end of the grace
+	 * period have been issued.
+	 */
+	urcu_wake_all_waiters(&waiters);
+}
+
+void synchronize_rcu(void)
+{
+	__synchronize_rcu(0);
+}
+
+void synchronize_rcu_expedited(void)
+{
+	uatomic_inc(&gp_expedited);
+	/*
+	 * Increment gp_expedited before reading gp_futex: a grace period
+	 * sleeping for readers is woken up, and busy-waits from now on.
+	 */
+	cmm_smp_mb();
+	wake_up_gp();
+	__synchronize_rcu(1);
+	uatomic_dec(&gp_expedited);
+}
+
+/*
+ * library wrappers to be used by non-LGPL compatible source code.
+ */
+
+void rcu_read_lock(void)
+{
+	_rcu_read_lock();
+}
+
+void rcu_read_unlock(void)
+{
+	_rcu_read_unlock();
+}
+
+/*
+ * Prefer the private expedited membarrier command, which only
+ * interrupts the CPUs running threads of this process, and must be
+ * registered before use. Fall back to the shared command. Without
+ * either, readers issue full memory barriers themselves.
+ */
+static void init_membarrier(void)
+{
+#ifdef SYS_membarrier
+	int mask;
+
+	mask = membarrier(URCU_MEMBARRIER_CMD_QUERY, 0);
+	if (mask < 0)
+		return;
+	if ((mask & URCU_MEMBARRIER_CMD_PRIVATE_EXPEDITED)
+	    && !membarrier(URCU_MEMBARRIER_CMD_REGISTER_PRIVATE_EXPEDITED, 0)) {
+		membarrier_cmd = URCU_MEMBARRIER_CMD_PRIVATE_EXPEDITED;
+	} else if (mask & URCU_MEMBARRIER_CMD_SHARED) {
+		membarrier_cmd = URCU_MEMBARRIER_CMD_SHARED;
+	} else {
+		return;
+	}
+	/*
+	 * Registration is complete before readers rely on
+	 * smp_mb_master() and drop their memory barriers.
+	 */
+	cmm_smp_mb();
+	CMM_STORE_SHARED(has_sys_membarrier, 1);
+#endif
+}
+
+/*
+ * Allocate the per-CPU counters. Called from the library constructor,
+ * and by the first reader if it runs before. The counters are never
+ * freed, since readers may use them until the process exits.
+ */
+void rcu_percpu_init(void)
+{
+	struct rcu_percpu_ctr *ctrs;
+	long nr_cpus;
+	int ret;
+
+	mutex_lock(&rcu_init_lock);
+	if (rcu_percpu_ctrs)
+		goto end;
+	nr_cpus = sysconf(_SC_NPROCESSORS_CONF);
+	if (nr_cpus <= 0)
+		nr_cpus = 1;
+	ret = posix_memalign((void **) &ctrs, CAA_CACHE_LINE_SIZE,
+			nr_cpus * sizeof(*ctrs));
+	if (ret)
+		urcu_die(ret);
+	memset(ctrs, 0, nr_cpus * sizeof(*ctrs));
+	init_membarrier();
+	rcu_percpu_nr_cpus = nr_cpus;
+	/* Initialize the counters before publishing them. */
+	cmm_smp_wmb();
+	CMM_STORE_SHARED(rcu_percpu_ctrs, ctrs);
+end:
+	mutex_unlock(&rcu_init_lock);
+}
+
+void rcu_exit(void)
+{
+	urcu_trace_exit();
+}
+
+/*
+ * Disable signals, allocate the counters if needed, and give the
+ * thread the slot it increments when it cannot use the counters of the
+ * CPU it runs on. Threads are spread over the slots starting from
+ * their current CPU, so atomic increments from different CPUs seldom
+ * share a cache line.
+ */
+void rcu_percpu_register(void)
+{
+	sigset_t newmask, oldmask;
+	int ret, cpu;
+
+	ret = sigfillset(&newmask);
+	assert(!ret);
+	ret = pthread_sigmask(SIG_SETMASK, &newmask, &oldmask);
+	assert(!ret);
+
+	/*
+	 * Check if a signal concurrently registered our thread since
+	 * the check in rcu_read_lock(). */
+	if (URCU_TLS(rcu_reader).slot)
+		goto end;
+
+	rcu_percpu_init();
+	cpu = sched_getcpu();
+	if (cpu < 0)
+		cpu = uatomic_add_return(&next_slot, 1);
+	URCU_TLS(rcu_reader).slot = cpu % rcu_percpu_nr_cpus + 1;
+end:
+	ret = pthread_sigmask(SIG_SETMASK, &oldmask, NULL);
+	assert(!ret);
+}
+
+DEFINE_RCU_FLAVOR(rcu_flavor);
+
+#include "urcu-call-rcu-impl.h"
+#include "urcu-defer-impl.h"
+#include "urcu-poll-impl.h"
@@ -0,0 +1,130 @@
+#ifndef _URCU_PERCPU_H
+#define _URCU_PERCPU_H
+
+/*
+ * urcu-percpu.h
+ *
+ * Userspace RCU header, per-CPU reader counters version.
+ *
+ * Readers count themselves in per-CPU counters rather than in a
+ * per-thread counter, so grace periods scan one counter slot per CPU,
+ * whatever the number of reader threads. Does not require thread
+ * registration nor unregistration.
+ *
+ * LGPL-compatible code should include this header with :
+ *
+ * #define _LGPL_SOURCE
+ * #include <urcu-percpu.h>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include <stdlib.h>
+#include <pthread.h>
+
+/*
+ * See urcu-pointer.h and urcu/static/urcu-pointer.h for pointer
+ * publication headers.
+ */
+#include <urcu-pointer.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <urcu/map/urcu-percpu.h>
+
+#ifdef _LGPL_SOURCE
+
+#include <urcu/static/urcu-percpu.h>
+
+/*
+ * Mappings for static use of the userspace RCU library.
+ * Should only be used in LGPL-compatible code.
+ */
+
+/*
+ * rcu_read_lock()
+ * rcu_read_unlock()
+ *
+ * Mark the beginning and end of a read-side critical section.
+ */
+#define rcu_read_lock_percpu		_rcu_read_lock
+#define rcu_read_unlock_percpu		_rcu_read_unlock
+
+#else /* !_LGPL_SOURCE */
+
+/*
+ * library wrappers to be used by non-LGPL compatible source code.
+ * See LGPL-only urcu/static/urcu-pointer.h for documentation.
+ */
+
+extern void rcu_read_lock(void);
+extern void rcu_read_unlock(void);
+
+#endif /* !_LGPL_SOURCE */
+
+extern void synchronize_rcu(void);
+extern void synchronize_rcu_expedited(void);
+
+/*
+ * Bounds of the number of busy-wait loops of synchronize_rcu() before
+ * it sleeps waiting for readers.
+ */
+extern int rcu_set_wait_spin(unsigned int min_attempts,
+			     unsigned int max_attempts);
+
+/*
+ * In the per-CPU version, the following functions are no-ops.
+ */
+static inline void rcu_register_thread(void)
+{
+}
+
+static inline void rcu_unregister_thread(void)
+{
+}
+
+static inline void rcu_init(void)
+{
+}
+
+/*
+ * Q.S. reporting are no-ops for these URCU flavors.
+ */
+static inline void rcu_quiescent_state(void)
+{
+}
+
+static inline void rcu_thread_offline(void)
+{
+}
+
+static inline void rcu_thread_online(void)
+{
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#include <urcu-call-rcu.h>
+#include <urcu-defer.h>
+#include <urcu-poll.h>
+#include <urcu-trace.h>
+#include <urcu-stats.h>
+#include <urcu-flavor.h>
+
+#endif /* _URCU_PERCPU_H */
@@ -0,0 +1,150 @@
+#ifndef _URCU_POLL_IMPL_H
+#define _URCU_POLL_IMPL_H
+
+/*
+ * urcu-poll-impl.h
+ *
+ * Userspace RCU library - grace period polling
+ *
+ * Copyright (c) 2012 Mathieu Desnoyers <mathieu.desnoyers@efficios.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/*
+ * The including flavor provides "rcu_gp_seq", its grace period sequence
+ * number. It is incremented by synchronize_rcu() when a grace period
+ * starts and when it completes, with rcu_gp_lock held, so it is odd
+ * while a grace period is in progress.
+ *
+ * A cookie is the sequence number which marks the end of the first
+ * grace period starting after the cookie is taken. Such grace period is
+ * driven by any concurrent synchronize_rcu() caller, or by the call_rcu
+ * worker thread: start_poll_synchronize_rcu() queues a single shared
+ * callback, which is re-queued until all requested cookies are reached.
+ */
+
+#include <stdint.h>
+
+#include <urcu/compiler.h>
+#include <urcu/arch.h>
+#include <urcu/uatomic.h>
+#include <urcu/system.h>
+
+#include "urcu-poll.h"
+
+/* Wrap-around safe sequence number comparison. */
+#define URCU_GP_SEQ_GE(a, b)	((long) ((a) - (b)) >= 0)
+
+static struct rcu_head gp_poll_head;
+static int32_t gp_poll_queued;
+static unsigned long gp_poll_requested;
+
+static void gp_poll_cb(struct rcu_head *head);
+
+static unsigned long gp_poll_snapshot(void)
+{
+	unsigned long seq;
+
+	/* Order prior removals before reading the sequence number. */
+	cmm_smp_mb();
+	seq = CMM_LOAD_SHARED(rcu_gp_seq);
+	/*
+	 * Skip the grace period in progress, if any: it may have
+	 * started before our removals.
+	 */
+	return (seq + 3) & ~1UL;
+}
+
+static void gp_poll_enqueue(void)
+{
+	if (uatomic_cmpxchg(&gp_poll_queued, 0, 1) == 0)
+		call_rcu(&gp_poll_head, gp_poll_cb);
+}
+
+/*
+ * Executed by the call_rcu worker thread after its grace period. Queue
+ * another grace period if cookies were requested after our callback
+ * was queued.
+ */
+static void gp_poll_cb(struct rcu_head *head)
+{
+	uatomic_set(&gp_poll_queued, 0);
+	/* Clear queued flag before reading requested cookie. */
+	cmm_smp_mb();
+	if (!URCU_GP_SEQ_GE(CMM_LOAD_SHARED(rcu_gp_seq),
+			uatomic_read(&gp_poll_requested)))
+		gp_poll_enqueue();
+}
+
+/*
+ * start_poll_synchronize_rcu - Start a grace period, return a cookie.
+ *
+ * Returns a cookie which can be passed to poll_state_synchronize_rcu()
+ * or cond_synchronize_rcu(). Never blocks waiting for a grace period.
+ */
+struct urcu_gp_poll_state start_poll_synchronize_rcu(void)
+{
+	struct urcu_gp_poll_state state;
+	unsigned long old, req;
+
+	state.grace_period_id = gp_poll_snapshot();
+
+	/* Keep the most recent cookie requested. */
+	old = uatomic_read(&gp_poll_requested);
+	do {
+		req = old;
+		if (URCU_GP_SEQ_GE(req, state.grace_period_id))
+			break;
+		old = uatomic_cmpxchg(&gp_poll_requested, req,
+				state.grace_period_id);
+	} while (old != req);
+	/* Write requested cookie before reading queued flag. */
+	cmm_smp_mb();
+	gp_poll_enqueue();
+	return state;
+}
+
+/*
+ * poll_state_synchronize_rcu - Check if a grace period has elapsed.
+ *
+ * Returns 1 if a full grace period has elapsed since the call to
+ * start_poll_synchronize_rcu() which returned "state", 0 otherwise.
+ * Never blocks.
+ */
+int poll_state_synchronize_rcu(struct urcu_gp_poll_state state)
+{
+	int ret;
+
+	ret = URCU_GP_SEQ_GE(CMM_LOAD_SHARED(rcu_gp_seq),
+			state.grace_period_id);
+	/* Read sequence number before following reclamation. */
+	cmm_smp_mb();
+	return ret;
+}
+
+/*
+ * cond_synchronize_rcu - Wait for a grace period if needed.
+ *
+ * Only calls synchronize_rcu() if no grace period has elapsed since the
+ * call to start_poll_synchronize_rcu() which returned "state".
+ */
+void cond_synchronize_rcu(struct urcu_gp_poll_state state)
+{
+	if (!poll_state_synchronize_rcu(state))
+		synchronize_rcu();
+}
+
+#endif /* _URCU_POLL_IMPL_H */
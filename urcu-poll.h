@@ -0,0 +1,59 @@
+#ifndef _URCU_POLL_H
+#define _URCU_POLL_H
+
+/*
+ * urcu-poll.h
+ *
+ * Userspace RCU header - grace period polling
+ *
+ * Copyright (c) 2012 Mathieu Desnoyers <mathieu.desnoyers@efficios.com>
+ *
+ * LGPL-compatible code should include this header with :
+ *
+ * #define _LGPL_SOURCE
+ * #include <urcu.h>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Grace period cookie returned by start_poll_synchronize_rcu(). Should
+ * be treated as opaque by callers.
+ */
+struct urcu_gp_poll_state {
+	unsigned long grace_period_id;
+};
+
+/*
+ * Important: see rcu-api.txt in userspace-rcu documentation for
+ * grace period polling usage detail.
+ *
+ * start_poll_synchronize_rcu() must be called from registered RCU
+ * read-side threads, outside of RCU read-side critical sections. For
+ * the QSBR flavor, the caller should be online.
+ */
+extern struct urcu_gp_poll_state start_poll_synchronize_rcu(void);
+extern int poll_state_synchronize_rcu(struct urcu_gp_poll_state state);
+extern void cond_synchronize_rcu(struct urcu_gp_poll_state state);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _URCU_POLL_H */
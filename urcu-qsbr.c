@@ -34,6 +34,7 @@
 #include <string.h>
 #include <errno.h>
 #include <poll.h>
+#include <time.h>
 
 #include "urcu/wfqueue.h"
 #include "urcu/map/urcu-qsbr.h"
@@ -43,6 +44,8 @@
 #include "urcu/tls-compat.h"
 
 #include "urcu-die.h"
+#include "urcu-wait.h"
+#include "urcu-reader-slab.h"
 
 /* Do not #define _LGPL_SOURCE to ensure we can emit the wrapper symbols */
 #undef _LGPL_SOURCE
@@ -51,7 +54,22 @@
 
 void __attribute__((destructor)) rcu_exit(void);
 
+/*
+ * rcu_gp_lock ensures mutual exclusion between threads calling
+ * synchronize_rcu().
+ */
 static pthread_mutex_t rcu_gp_lock = PTHREAD_MUTEX_INITIALIZER;
+/*
+ * rcu_registry_lock ensures mutual exclusion between threads
+ * registering and unregistering themselves to/from the registry, and
+ * with threads reading that registry from synchronize_rcu(). However,
+ * this lock is not held all the way through the completion of awaiting
+ * for the grace period. It is sporadically released between iterations
+ * on the registry, so thread registration and unregistration do not
+ * have to wait for a whole grace period to complete.
+ * rcu_registry_lock may nest inside rcu_gp_lock.
+ */
+static pthread_mutex_t rcu_registry_lock = PTHREAD_MUTEX_INITIALIZER;
 
 int32_t gp_futex;
 
@@ -61,10 +79,18 @@ int32_t gp_futex;
 unsigned long rcu_gp_ctr = RCU_GP_ONLINE;
 
 /*
- * Active attempts to check for reader Q.S. before calling futex().
+ * Initial active attempts to check for reader Q.S. before calling futex(),
+ * adapted to the readers at runtime by urcu-spin-impl.h.
  */
 #define RCU_QS_ACTIVE_ATTEMPTS 100
 
+#define RCU_FLAVOR_NAME	"qsbr"
+
+#include "urcu-stall-impl.h"
+#include "urcu-trace-impl.h"
+#include "urcu-stats-impl.h"
+#include "urcu-spin-impl.h"
+
 /*
  * Written to only by each individual reader. Read by both the reader and the
  * writers.
@@ -78,6 +104,36 @@ DEFINE_URCU_TLS(unsigned int, rand_yield);
 
 static CDS_LIST_HEAD(registry);
 
+/*
+ * Readers which have gone through a quiescent state during the grace
+ * period in progress. Moved back to the registry when it completes.
+ */
+static CDS_LIST_HEAD(qsreaders);
+
+#ifdef CONFIG_RCU_READER_SLAB
+/* Reader counters, scanned by synchronize_rcu(). */
+static struct urcu_reader_slab *reader_slabs;
+#endif
+
+/*
+ * Grace period sequence number for the polling API. Odd while a grace
+ * period is in progress. Written to only by writer with mutex taken.
+ */
+static unsigned long rcu_gp_seq;
+
+/*
+ * Queue keeping threads awaiting to wait for a grace period. Contains
+ * struct urcu_wait_node objects, allocated on the waiters' stacks.
+ */
+static DEFINE_URCU_WAIT_QUEUE(gp_waiters);
+
+/*
+ * Number of synchronize_rcu_expedited() calls in progress. While
+ * non-zero, grace periods busy-wait for readers instead of sleeping on
+ * gp_futex.
+ */
+static int gp_expedited;
+
 static void mutex_lock(pthread_mutex_t *mutex)
 {
 	int ret;
@@ -106,22 +162,127 @@ static void mutex_unlock(pthread_mutex_t *mutex)
 
 /*
  * synchronize_rcu() waiting. Single thread.
+ * Always called with rcu_registry lock held. Releases this lock and
+ * grabs it again. Holds the lock when it returns.
  */
-static void wait_gp(void)
+static void wait_gp(struct urcu_stall_check *stall)
 {
+	struct timespec timeout;
+
 	/* Read reader_gp before read futex */
 	cmm_smp_rmb();
-	if (uatomic_read(&gp_futex) == -1)
+	/* Temporarily unlock the registry lock. */
+	mutex_unlock(&rcu_registry_lock);
+	if (uatomic_read(&gp_futex) == -1) {
+		urcu_stats_sleep();
+		urcu_trace(RCU_TRACE_GP_SLEEP, 0);
 		futex_noasync(&gp_futex, FUTEX_WAIT, -1,
-		      NULL, NULL, 0);
+		      urcu_stall_check_timeout(stall, &timeout), NULL, 0);
+		urcu_trace(RCU_TRACE_GP_WAKEUP, 0);
+	}
+	/* Re-lock the registry lock before the next loop. */
+	mutex_lock(&rcu_registry_lock);
 }
 
-static void update_counter_and_wait(void)
+static unsigned long *reader_ctr(struct rcu_reader *index)
+{
+#ifdef CONFIG_RCU_READER_SLAB
+	return index->ctr;
+#else
+	return &index->ctr;
+#endif
+}
+
+static void account_stall(struct rcu_reader *index, uint64_t stall_ns)
+{
+	index->stalled = 0;
+	index->stalls++;
+	index->stall_total_ns += stall_ns;
+	if (stall_ns > index->stall_max_ns)
+		index->stall_max_ns = stall_ns;
+}
+
+/*
+ * Called when the grace period is about to sleep, or has been woken
+ * up, with "start" the time at which it first had to sleep. Updates
+ * the stall time of readers still awaited, and accounts the stall of
+ * readers which went through a quiescent state since the last call.
+ * Readers report their quiescent state while a grace period sleeps,
+ * since it wakes up, so the stall time is accurate to the wakeup
+ * latency.
+ */
+static void update_stalls(uint64_t start, int done)
+{
+	struct rcu_reader *index;
+	uint64_t now = urcu_stall_now();
+
+	cds_list_for_each_entry(index, &registry, node) {
+		if (!done && rcu_gp_ongoing(reader_ctr(index))) {
+			index->stalled = 1;
+			index->stall_ns = now - start;
+		} else if (index->stalled) {
+			account_stall(index, now - start);
+		}
+	}
+	cds_list_for_each_entry(index, &qsreaders, node) {
+		if (index->stalled)
+			account_stall(index, now - start);
+	}
+}
+
+/*
+ * Report the readers the grace period is still waiting for. Called
+ * with the registry lock held.
+ */
+static void report_stalled_readers(struct urcu_stall_check *stall)
+{
+	struct rcu_reader *index;
+
+	cds_list_for_each_entry(index, &registry, node) {
+		if (rcu_gp_ongoing(reader_ctr(index)))
+			urcu_stall_report(stall, index->tid, 0);
+	}
+}
+
+/*
+ * Stop awaiting readers which are offline or have gone through a
+ * quiescent state since the counter update. Returns nonzero if some
+ * readers are still awaited.
+ */
+static int scan_readers(void)
 {
-	CDS_LIST_HEAD(qsreaders);
-	int wait_loops = 0;
+	unsigned long nr_scanned = 0;
+#ifdef CONFIG_RCU_READER_SLAB
+	int ret;
+
+	ret = urcu_reader_slab_scan(reader_slabs, rcu_gp_ongoing, &nr_scanned);
+	urcu_stats_scanned(nr_scanned);
+	return ret;
+#else
 	struct rcu_reader *index, *tmp;
 
+	cds_list_for_each_entry_safe(index, tmp, &registry, node) {
+		nr_scanned++;
+		if (!rcu_gp_ongoing(&index->ctr))
+			cds_list_move(&index->node, &qsreaders);
+	}
+	urcu_stats_scanned(nr_scanned);
+	return !cds_list_empty(&registry);
+#endif
+}
+
+/*
+ * Always called with rcu_registry lock held. Releases this lock between
+ * iterations and grabs it again. Holds the lock when it returns.
+ */
+static void update_counter_and_wait(void)
+{
+	unsigned int attempts, wait_loops = 0;
+	struct rcu_reader *index;
+	struct urcu_stall_check stall;
+	struct urcu_spin spin;
+	uint64_t stall_start = 0;
+
 #if (CAA_BITS_PER_LONG < 64)
 	/* Switch parity: 0 -> 1, 1 -> 0 */
 	CMM_STORE_SHARED(rcu_gp_ctr, rcu_gp_ctr ^ RCU_GP_CTR);
@@ -146,12 +307,33 @@ static void update_counter_and_wait(void)
 	 */
 	cmm_smp_mb();
 
+#ifdef CONFIG_RCU_READER_SLAB
+	urcu_reader_slab_start_scan(reader_slabs);
+#endif
+	urcu_stall_check_init(&stall, RCU_FLAVOR_NAME);
+	attempts = urcu_spin_begin(&spin);
+
 	/*
 	 * Wait for each thread rcu_reader_qs_gp count to become 0.
 	 */
 	for (;;) {
 		wait_loops++;
-		if (wait_loops >= RCU_QS_ACTIVE_ATTEMPTS) {
+		if (wait_loops >= attempts
+		    && uatomic_read(&gp_expedited)) {
+			/*
+			 * Expedited grace period: keep busy-waiting. Readers
+			 * still flagged as waiting see gp_futex reset, and
+			 * skip the wakeup.
+			 */
+			if (wait_loops > attempts)
+				uatomic_set(&gp_futex, 0);
+			urcu_spin_discard(&spin);
+			wait_loops = 0;
+		}
+		if (wait_loops >= attempts) {
+			if (!stall_start)
+				stall_start = urcu_stall_now();
+			update_stalls(stall_start, 0);
 			uatomic_set(&gp_futex, -1);
 			/*
 			 * Write futex before write waiting (the other side
@@ -159,37 +341,51 @@ static void update_counter_and_wait(void)
 			 */
 			cmm_smp_wmb();
 			cds_list_for_each_entry(index, &registry, node) {
+#ifdef CONFIG_RCU_READER_SLAB
+				/*
+				 * The registry also holds the readers no
+				 * longer awaited: don't have them wake us up.
+				 */
+				if (!rcu_gp_ongoing(reader_ctr(index)))
+					continue;
+#endif
 				_CMM_STORE_SHARED(index->waiting, 1);
 			}
 			/* Write futex before read reader_gp */
 			cmm_smp_mb();
 		}
-		cds_list_for_each_entry_safe(index, tmp, &registry, node) {
-			if (!rcu_gp_ongoing(&index->ctr))
-				cds_list_move(&index->node, &qsreaders);
-		}
-
-		if (cds_list_empty(&registry)) {
-			if (wait_loops >= RCU_QS_ACTIVE_ATTEMPTS) {
+		if (!scan_readers()) {
+			if (wait_loops >= attempts) {
 				/* Read reader_gp before write futex */
 				cmm_smp_mb();
 				uatomic_set(&gp_futex, 0);
 			}
 			break;
 		} else {
-			if (wait_loops >= RCU_QS_ACTIVE_ATTEMPTS) {
-				wait_gp();
+			if (urcu_stall_check_due(&stall))
+				report_stalled_readers(&stall);
+			if (wait_loops >= attempts) {
+				wait_gp(&stall);
 			} else {
+				/* Temporarily unlock the registry lock. */
+				mutex_unlock(&rcu_registry_lock);
 #ifndef HAS_INCOHERENT_CACHES
 				caa_cpu_relax();
 #else /* #ifndef HAS_INCOHERENT_CACHES */
 				cmm_smp_mb();
 #endif /* #else #ifndef HAS_INCOHERENT_CACHES */
+				/* Re-lock the registry lock before the next loop. */
+				mutex_lock(&rcu_registry_lock);
 			}
 		}
 	}
+	urcu_spin_end(&spin, wait_loops);
+	if (stall_start)
+		update_stalls(stall_start, 1);
+	urcu_trace(RCU_TRACE_GP_PHASE, wait_loops);
 	/* put back the reader list in the registry */
 	cds_list_splice(&qsreaders, &registry);
+	CDS_INIT_LIST_HEAD(&qsreaders);
 }
 
 /*
@@ -198,11 +394,13 @@ static void update_counter_and_wait(void)
  */
 
 #if (CAA_BITS_PER_LONG < 64)
-void synchronize_rcu(void)
+static void __synchronize_rcu(int expedited)
 {
+	DEFINE_URCU_WAIT_NODE(wait, URCU_WAIT_WAITING);
+	struct urcu_waiters waiters;
 	unsigned long was_online;
 
-	was_online = URCU_TLS(rcu_reader).ctr;
+	was_online = _rcu_read_ongoing();
 
 	/* All threads should read qparity before accessing data structure
 	 * where new ptr points to.  In the "then" case, rcu_thread_offline
@@ -217,8 +415,42 @@ void synchronize_rcu(void)
 	else
 		cmm_smp_mb();
 
+	/*
+	 * Add ourself to gp_waiters queue of threads awaiting to wait
+	 * for a grace period. Proceed to perform the grace period only
+	 * if we are the first thread added into the queue.
+	 */
+	if (urcu_wait_add(&gp_waiters, &wait) != 0) {
+		/* Not first in queue: will be awakened by another thread. */
+		if (expedited)
+			urcu_busy_wait(&wait);
+		else
+			urcu_adaptative_busy_wait(&wait);
+		goto gp_end;
+	}
+	/* We won't need to wake ourself up */
+	urcu_wait_set_state(&wait, URCU_WAIT_RUNNING);
+
 	mutex_lock(&rcu_gp_lock);
 
+	/*
+	 * Move all waiters into our local queue. They have all been
+	 * queued before we start the grace period, so the grace period
+	 * performed below is also theirs.
+	 */
+	urcu_move_waiters(&waiters, &gp_waiters);
+
+	/*
+	 * Start grace period sequence for the polling API, before the
+	 * counter update.
+	 */
+	CMM_STORE_SHARED(rcu_gp_seq, rcu_gp_seq + 1);
+	urcu_trace(RCU_TRACE_GP_BEGIN, expedited);
+	urcu_stats_gp_begin();
+	cmm_smp_mb();
+
+	mutex_lock(&rcu_registry_lock);
+
 	if (cds_list_empty(&registry))
 		goto out;
 
@@ -249,8 +481,19 @@ void synchronize_rcu(void)
 	 */
 	update_counter_and_wait();	/* 1 -> 0, wait readers in parity 1 */
 out:
+	mutex_unlock(&rcu_registry_lock);
+	/* End grace period sequence after reader accesses. */
+	cmm_smp_mb();
+	urcu_stats_gp_end(expedited);
+	CMM_STORE_SHARED(rcu_gp_seq, rcu_gp_seq + 1);
+	urcu_trace(RCU_TRACE_GP_END, expedited);
 	mutex_unlock(&rcu_gp_lock);
 
+	/*
+	 * Wakeup waiters only after we have completed the grace period.
+	 */
+	urcu_wake_all_waiters(&waiters);
+gp_end:
 	/*
 	 * Finish waiting for reader threads before letting the old ptr being
 	 * freed.
@@ -261,11 +504,13 @@ out:
 		cmm_smp_mb();
 }
 #else /* !(CAA_BITS_PER_LONG < 64) */
-void synchronize_rcu(void)
+static void __synchronize_rcu(int expedited)
 {
+	DEFINE_URCU_WAIT_NODE(wait, URCU_WAIT_WAITING);
+	struct urcu_waiters waiters;
 	unsigned long was_online;
 
-	was_online = URCU_TLS(rcu_reader).ctr;
+	was_online = _rcu_read_ongoing();
 
 	/*
 	 * Mark the writer thread offline to make sure we don't wait for
@@ -277,13 +522,59 @@ void synchronize_rcu(void)
 	else
 		cmm_smp_mb();
 
+	/*
+	 * Add ourself to gp_waiters queue of threads awaiting to wait
+	 * for a grace period. Proceed to perform the grace period only
+	 * if we are the first thread added into the queue.
+	 */
+	if (urcu_wait_add(&gp_waiters, &wait) != 0) {
+		/* Not first in queue: will be awakened by another thread. */
+		if (expedited)
+			urcu_busy_wait(&wait);
+		else
+			urcu_adaptative_busy_wait(&wait);
+		goto gp_end;
+	}
+	/* We won't need to wake ourself up */
+	urcu_wait_set_state(&wait, URCU_WAIT_RUNNING);
+
 	mutex_lock(&rcu_gp_lock);
+
+	/*
+	 * Move all waiters into our local queue. They have all been
+	 * queued before we start the grace period, so the grace period
+	 * performed below is also theirs.
+	 */
+	urcu_move_waiters(&waiters, &gp_waiters);
+
+	/*
+	 * Start grace period sequence for the polling API, before the
+	 * counter update.
+	 */
+	CMM_STORE_SHARED(rcu_gp_seq, rcu_gp_seq + 1);
+	urcu_trace(RCU_TRACE_GP_BEGIN, expedited);
+	urcu_stats_gp_begin();
+	cmm_smp_mb();
+
+	mutex_lock(&rcu_registry_lock);
+
 	if (cds_list_empty(&registry))
 		goto out;
 	update_counter_and_wait();
 out:
+	mutex_unlock(&rcu_registry_lock);
+	/* End grace period sequence after reader accesses. */
+	cmm_smp_mb();
+	urcu_stats_gp_end(expedited);
+	CMM_STORE_SHARED(rcu_gp_seq, rcu_gp_seq + 1);
+	urcu_trace(RCU_TRACE_GP_END, expedited);
 	mutex_unlock(&rcu_gp_lock);
 
+	/*
+	 * Wakeup waiters only after we have completed the grace period.
+	 */
+	urcu_wake_all_waiters(&waiters);
+gp_end:
 	if (was_online)
 		rcu_thread_online();
 	else
@@ -291,6 +582,28 @@ out:
 }
 #endif  /* !(CAA_BITS_PER_LONG < 64) */
 
+void synchronize_rcu(void)
+{
+	__synchronize_rcu(0);
+}
+
+void synchronize_rcu_expedited(void)
+{
+	uatomic_inc(&gp_expedited);
+	/*
+	 * Increment gp_expedited before reading gp_futex: a grace period
+	 * sleeping for readers is woken up, and busy-waits from now on.
+	 */
+	cmm_smp_mb();
+	if (uatomic_read(&gp_futex) == -1) {
+		uatomic_set(&gp_futex, 0);
+		futex_noasync(&gp_futex, FUTEX_WAKE, 1,
+		      NULL, NULL, 0);
+	}
+	__synchronize_rcu(1);
+	uatomic_dec(&gp_expedited);
+}
+
 /*
  * library wrappers to be used by non-LGPL compatible source code.
  */
@@ -320,14 +633,93 @@ void rcu_thread_online(void)
 	_rcu_thread_online();
 }
 
+/*
+ * Blocking calls made in extended quiescent state: the calling thread
+ * goes offline for the duration of the call if it is online, so it
+ * does not hold back grace periods while blocked. This costs exactly
+ * what rcu_thread_offline() and rcu_thread_online() around the call
+ * do: the barriers order the reader counter against the grace period
+ * waiting flag, and the wakeup is already skipped when no grace period
+ * waits for this thread.
+ */
+#define OFFLINE_CALL(call)					\
+	({							\
+		int _was_online = _rcu_read_ongoing();		\
+		int _ret, _saved_errno;				\
+								\
+		if (_was_online)				\
+			_rcu_thread_offline();			\
+		_ret = (call);					\
+		_saved_errno = errno;				\
+		if (_was_online)				\
+			_rcu_thread_online();			\
+		errno = _saved_errno;				\
+		_ret;						\
+	})
+
+int rcu_qsbr_poll(struct pollfd *fds, nfds_t nfds, int timeout)
+{
+	return OFFLINE_CALL(poll(fds, nfds, timeout));
+}
+
+#ifdef __linux__
+int rcu_qsbr_epoll_wait(int epfd, struct epoll_event *events,
+		int maxevents, int timeout)
+{
+	return OFFLINE_CALL(epoll_wait(epfd, events, maxevents, timeout));
+}
+#endif
+
+int rcu_qsbr_futex_wait(int32_t *uaddr, int32_t val,
+		const struct timespec *timeout)
+{
+	return OFFLINE_CALL(futex_noasync(uaddr, FUTEX_WAIT, val, timeout,
+			NULL, 0));
+}
+
+static void report_stats(struct cds_list_head *list,
+		void (*fn)(const struct rcu_qsbr_reader_stats *stats, void *priv),
+		void *priv)
+{
+	struct rcu_qsbr_reader_stats stats;
+	struct rcu_reader *index;
+
+	cds_list_for_each_entry(index, list, node) {
+		stats.tid = index->tid;
+		stats.stalls = index->stalls;
+		stats.stall_max_ns = index->stall_max_ns;
+		stats.stall_total_ns = index->stall_total_ns;
+		/* Include the stall in progress, if any. */
+		if (index->stalled) {
+			stats.stall_total_ns += index->stall_ns;
+			if (index->stall_ns > stats.stall_max_ns)
+				stats.stall_max_ns = index->stall_ns;
+		}
+		fn(&stats, priv);
+	}
+}
+
+void rcu_qsbr_for_each_reader_stats(
+		void (*fn)(const struct rcu_qsbr_reader_stats *stats, void *priv),
+		void *priv)
+{
+	mutex_lock(&rcu_registry_lock);
+	report_stats(&registry, fn, priv);
+	report_stats(&qsreaders, fn, priv);
+	mutex_unlock(&rcu_registry_lock);
+}
+
 void rcu_register_thread(void)
 {
 	URCU_TLS(rcu_reader).tid = pthread_self();
-	assert(URCU_TLS(rcu_reader).ctr == 0);
+	assert(!_rcu_read_ongoing());
 
-	mutex_lock(&rcu_gp_lock);
+	mutex_lock(&rcu_registry_lock);
+#ifdef CONFIG_RCU_READER_SLAB
+	URCU_TLS(rcu_reader).ctr = urcu_reader_slab_alloc(&reader_slabs);
+#endif
 	cds_list_add(&URCU_TLS(rcu_reader).node, &registry);
-	mutex_unlock(&rcu_gp_lock);
+	mutex_unlock(&rcu_registry_lock);
 	_rcu_thread_online();
 }
 
@@ -338,9 +730,13 @@ void rcu_unregister_thread(void)
 	 * with a waiting writer.
 	 */
 	_rcu_thread_offline();
-	mutex_lock(&rcu_gp_lock);
+	mutex_lock(&rcu_registry_lock);
 	cds_list_del(&URCU_TLS(rcu_reader).node);
-	mutex_unlock(&rcu_gp_lock);
+#ifdef CONFIG_RCU_READER_SLAB
+	urcu_reader_slab_free(reader_slabs, URCU_TLS(rcu_reader).ctr);
+	URCU_TLS(rcu_reader).ctr = NULL;
+#endif
+	mutex_unlock(&rcu_registry_lock);
 }
 
 void rcu_exit(void)
@@ -350,9 +746,11 @@ void rcu_exit(void)
 	 * readers, and left running at exit.
 	 * assert(cds_list_empty(&registry));
 	 */
+	urcu_trace_exit();
 }
 
 DEFINE_RCU_FLAVOR(rcu_flavor);
 
 #include "urcu-call-rcu-impl.h"
 #include "urcu-defer-impl.h"
+#include "urcu-poll-impl.h"
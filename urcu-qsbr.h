@@ -30,6 +30,12 @@
 
 #include <stdlib.h>
 #include <pthread.h>
+#include <stdint.h>
+#include <poll.h>
+#include <time.h>
+#ifdef __linux__
+#include <sys/epoll.h>
+#endif
 
 /*
  * See urcu-pointer.h and urcu/static/urcu-pointer.h for pointer
@@ -114,6 +120,14 @@ extern void rcu_thread_online(void);
 #endif /* !_LGPL_SOURCE */
 
 extern void synchronize_rcu(void);
+extern void synchronize_rcu_expedited(void);
+
+/*
+ * Bounds of the number of busy-wait loops of synchronize_rcu() before
+ * it sleeps waiting for readers.
+ */
+extern int rcu_set_wait_spin(unsigned int min_attempts,
+			     unsigned int max_attempts);
 
 /*
  * Reader thread registration.
@@ -121,12 +135,51 @@ extern void synchronize_rcu(void);
 extern void rcu_register_thread(void);
 extern void rcu_unregister_thread(void);
 
+/*
+ * Blocking calls performed in extended quiescent state: an online
+ * thread is put offline for the duration of the call, and back online
+ * when it returns. Same return value and errno as the wrapped call.
+ */
+extern int rcu_qsbr_poll(struct pollfd *fds, nfds_t nfds, int timeout);
+#ifdef __linux__
+extern int rcu_qsbr_epoll_wait(int epfd, struct epoll_event *events,
+		int maxevents, int timeout);
+#endif
+/* Wait while *uaddr == val, as FUTEX_WAIT. */
+extern int rcu_qsbr_futex_wait(int32_t *uaddr, int32_t val,
+		const struct timespec *timeout);
+
+/*
+ * Per-reader statistics of the grace periods which had to sleep
+ * waiting for the reader to report a quiescent state or go offline.
+ */
+struct rcu_qsbr_reader_stats {
+	pthread_t tid;
+	unsigned long stalls;		/* Number of such grace periods */
+	uint64_t stall_max_ns;		/* Longest wait for the reader */
+	uint64_t stall_total_ns;	/* Sum of the waits for the reader */
+};
+
+/*
+ * Call fn() with the statistics of each registered reader, including
+ * the wait of a grace period in progress. fn() is called with the
+ * registry lock held: it must not register or unregister threads, nor
+ * wait for a grace period.
+ */
+extern void rcu_qsbr_for_each_reader_stats(
+		void (*fn)(const struct rcu_qsbr_reader_stats *stats, void *priv),
+		void *priv);
+
 #ifdef __cplusplus 
 }
 #endif
 
 #include <urcu-call-rcu.h>
 #include <urcu-defer.h>
+#include <urcu-poll.h>
+#include <urcu-stall.h>
+#include <urcu-trace.h>
+#include <urcu-stats.h>
 #include <urcu-flavor.h>
 
 #endif /* _URCU_QSBR_H */
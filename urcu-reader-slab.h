@@ -0,0 +1,168 @@
+#ifndef _URCU_READER_SLAB_H
+#define _URCU_READER_SLAB_H
+
+/*
+ * urcu-reader-slab.h
+ *
+ * Userspace RCU library - packed reader counter registry
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/*
+ * With CONFIG_RCU_READER_SLAB, reader counters are not kept in each
+ * thread's TLS, but in slots of slabs owned by the library. Each slot
+ * sits on its own cache line, so readers do not false-share, and the
+ * slots of a slab are contiguous, so synchronize_rcu() reads them
+ * sequentially rather than chasing the registry list across each
+ * thread's TLS. Each slab keeps a bitmap of allocated slots and a
+ * bitmap of slots still awaited by the current registry scan, which
+ * replaces moving list nodes to a quiescent list.
+ *
+ * Slabs are never freed, so the counter pointer handed to a reader
+ * thread stays valid even if synchronize_rcu() is concurrently scanning
+ * with the registry lock released. All functions below must be called
+ * with the registry lock held.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <urcu/compiler.h>
+#include <urcu/arch.h>
+
+#include "urcu-die.h"
+
+/* Number of reader slots per slab: one bit each in a long bitmap. */
+#define URCU_READER_SLAB_SLOTS		CAA_BITS_PER_LONG
+
+/* Distance, in slots, of the counter prefetched ahead of the scan. */
+#define URCU_READER_SLAB_PREFETCH	4
+
+struct urcu_reader_slot {
+	unsigned long ctr;
+} __attribute__((aligned(CAA_CACHE_LINE_SIZE)));
+
+struct urcu_reader_slab {
+	struct urcu_reader_slot slots[URCU_READER_SLAB_SLOTS];
+	unsigned long used;		/* Allocated slots */
+	unsigned long pending;		/* Slots awaited by the current scan */
+	struct urcu_reader_slab *next;
+} __attribute__((aligned(CAA_CACHE_LINE_SIZE)));
+
+/*
+ * Allocate a counter slot, initialized to 0, for a registering reader
+ * thread. The new slot is also awaited by a scan in progress, so a
+ * reader registering while synchronize_rcu() is waiting is checked
+ * exactly like readers already present in the registry.
+ */
+static inline
+unsigned long *urcu_reader_slab_alloc(struct urcu_reader_slab **head)
+{
+	struct urcu_reader_slab *slab, **tail = head;
+	unsigned int i;
+	int ret;
+
+	for (slab = *head; slab; slab = slab->next) {
+		if (~slab->used)
+			goto found;
+		tail = &slab->next;
+	}
+	ret = posix_memalign((void **) &slab, CAA_CACHE_LINE_SIZE,
+			sizeof(*slab));
+	if (ret)
+		urcu_die(ret);
+	memset(slab, 0, sizeof(*slab));
+	/* Append, so slab addresses are scanned in allocation order. */
+	*tail = slab;
+found:
+	for (i = 0; slab->used & (1UL << i); i++)
+		;
+	slab->slots[i].ctr = 0;
+	slab->used |= 1UL << i;
+	slab->pending |= 1UL << i;
+	return &slab->slots[i].ctr;
+}
+
+static inline
+void urcu_reader_slab_free(struct urcu_reader_slab *head, unsigned long *ctr)
+{
+	struct urcu_reader_slot *slot;
+	struct urcu_reader_slab *slab;
+	unsigned long mask;
+
+	slot = caa_container_of(ctr, struct urcu_reader_slot, ctr);
+	for (slab = head; slab; slab = slab->next) {
+		if (slot < slab->slots
+		    || slot >= slab->slots + URCU_READER_SLAB_SLOTS)
+			continue;
+		mask = 1UL << (slot - slab->slots);
+		assert(slab->used & mask);
+		slab->used &= ~mask;
+		slab->pending &= ~mask;
+		return;
+	}
+	assert(0);
+}
+
+/*
+ * Begin a registry scan: every allocated slot is awaited.
+ */
+static inline
+void urcu_reader_slab_start_scan(struct urcu_reader_slab *head)
+{
+	struct urcu_reader_slab *slab;
+
+	for (slab = head; slab; slab = slab->next)
+		slab->pending = slab->used;
+}
+
+/*
+ * Stop awaiting the slots for which ongoing() returns 0. Returns
+ * nonzero if some slots are still awaited. Adds the number of slots
+ * checked to *nr_scanned.
+ */
+static inline
+int urcu_reader_slab_scan(struct urcu_reader_slab *head,
+		int (*ongoing)(unsigned long *ctr),
+		unsigned long *nr_scanned)
+{
+	struct urcu_reader_slab *slab;
+	int remaining = 0;
+
+	for (slab = head; slab; slab = slab->next) {
+		unsigned long pending = slab->pending;
+		unsigned int i;
+
+		if (!pending)
+			continue;
+		*nr_scanned += __builtin_popcountl(pending);
+		for (i = 0; i < URCU_READER_SLAB_SLOTS; i++) {
+			if (i + URCU_READER_SLAB_PREFETCH < URCU_READER_SLAB_SLOTS
+			    && (pending & (1UL << (i + URCU_READER_SLAB_PREFETCH))))
+				__builtin_prefetch(&slab->slots[i + URCU_READER_SLAB_PREFETCH].ctr);
+			if (!(pending & (1UL << i)))
+				continue;
+			if (!ongoing(&slab->slots[i].ctr))
+				pending &= ~(1UL << i);
+		}
+		slab->pending = pending;
+		if (pending)
+			remaining = 1;
+	}
+	return remaining;
+}
+
+#endif /* _URCU_READER_SLAB_H */
@@ -0,0 +1,163 @@
+#ifndef _URCU_SPIN_IMPL_H
+#define _URCU_SPIN_IMPL_H
+
+/*
+ * urcu-spin-impl.h
+ *
+ * Userspace RCU library - adaptive busy-waiting of grace periods
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/*
+ * The waiting loop of the including flavor busy-waits for the number
+ * of loops returned by urcu_spin_begin() before sleeping, and reports
+ * the number of loops it went through to urcu_spin_end(), with
+ * rcu_gp_lock held. The including flavor defines RCU_QS_ACTIVE_ATTEMPTS,
+ * the initial number of attempts.
+ *
+ * The number of attempts follows the time readers take to exit their
+ * critical sections, measured in busy-wait loops, averaged over the
+ * previous waits: twice the average, if it is within the maximum
+ * number of attempts. Readers taking longer are better waited for by
+ * sleeping, which costs about as much as a busy-wait of the maximum
+ * number of attempts: the minimum number of attempts is used then.
+ * When the wait ends during the busy-wait, it also gives the cost of a
+ * loop, which converts the duration of the waits which ended after
+ * sleeping into loops.
+ *
+ * Setting the same minimum and maximum disables adaptation, and the
+ * timestamps it needs.
+ */
+
+#include <stdint.h>
+#include <errno.h>
+#include <time.h>
+
+#include <urcu/compiler.h>
+#include <urcu/system.h>
+
+#include "urcu-die.h"
+
+#define RCU_QS_MIN_ATTEMPTS	10
+#define RCU_QS_MAX_ATTEMPTS	1000
+
+/* Log2 of the weight of past waits in the averages. */
+#define URCU_SPIN_AVG_SHIFT	3
+
+static unsigned int rcu_spin_min_attempts = RCU_QS_MIN_ATTEMPTS;
+static unsigned int rcu_spin_max_attempts = RCU_QS_MAX_ATTEMPTS;
+
+/* Protected by rcu_gp_lock. */
+static unsigned int urcu_spin_attempts = RCU_QS_ACTIVE_ATTEMPTS;
+static uint64_t urcu_spin_loop_ns;	/* Average cost of a loop */
+static uint64_t urcu_spin_exit_loops;	/* Average reader exit time */
+
+struct urcu_spin {
+	uint64_t start;		/* 0 if the wait is not measured */
+	unsigned int attempts;
+};
+
+static inline uint64_t urcu_spin_now(void)
+{
+	struct timespec ts;
+
+	if (clock_gettime(CLOCK_MONOTONIC, &ts))
+		urcu_die(errno);
+	return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static inline uint64_t urcu_spin_avg(uint64_t avg, uint64_t sample)
+{
+	if (!avg)
+		return sample;
+	return avg - (avg >> URCU_SPIN_AVG_SHIFT)
+		+ (sample >> URCU_SPIN_AVG_SHIFT);
+}
+
+int rcu_set_wait_spin(unsigned int min_attempts, unsigned int max_attempts)
+{
+	if (!min_attempts || min_attempts > max_attempts) {
+		errno = EINVAL;
+		return -EINVAL;
+	}
+	CMM_STORE_SHARED(rcu_spin_min_attempts, min_attempts);
+	CMM_STORE_SHARED(rcu_spin_max_attempts, max_attempts);
+	return 0;
+}
+
+/*
+ * Called when a grace period starts waiting for readers. Returns the
+ * number of busy-wait loops before sleeping.
+ */
+static inline unsigned int urcu_spin_begin(struct urcu_spin *spin)
+{
+	unsigned int min = CMM_LOAD_SHARED(rcu_spin_min_attempts);
+	unsigned int max = CMM_LOAD_SHARED(rcu_spin_max_attempts);
+
+	/* Bounds set concurrently by rcu_set_wait_spin(). */
+	if (caa_unlikely(min > max))
+		min = max;
+	if (urcu_spin_attempts < min)
+		urcu_spin_attempts = min;
+	if (urcu_spin_attempts > max)
+		urcu_spin_attempts = max;
+	spin->attempts = urcu_spin_attempts;
+	spin->start = min != max ? urcu_spin_now() : 0;
+	return spin->attempts;
+}
+
+/*
+ * Do not learn from this wait, e.g. because it is expedited and never
+ * sleeps.
+ */
+static inline void urcu_spin_discard(struct urcu_spin *spin)
+{
+	spin->start = 0;
+}
+
+/*
+ * Called when the wait ends, after "loops" loops. The wait slept if
+ * loops reached the number of attempts.
+ */
+static inline void urcu_spin_end(struct urcu_spin *spin, unsigned int loops)
+{
+	unsigned int min = CMM_LOAD_SHARED(rcu_spin_min_attempts);
+	unsigned int max = CMM_LOAD_SHARED(rcu_spin_max_attempts);
+	uint64_t elapsed, exit_loops;
+
+	if (!spin->start || !loops)
+		return;
+	elapsed = urcu_spin_now() - spin->start;
+	if (loops < spin->attempts) {
+		urcu_spin_loop_ns = urcu_spin_avg(urcu_spin_loop_ns,
+				elapsed / loops ? elapsed / loops : 1);
+		exit_loops = loops;
+	} else if (urcu_spin_loop_ns) {
+		exit_loops = elapsed / urcu_spin_loop_ns;
+	} else {
+		return;
+	}
+	urcu_spin_exit_loops = urcu_spin_avg(urcu_spin_exit_loops,
+			exit_loops ? exit_loops : 1);
+	if (urcu_spin_exit_loops > max)
+		urcu_spin_attempts = min;
+	else if (2 * urcu_spin_exit_loops > max)
+		urcu_spin_attempts = max;
+	else
+		urcu_spin_attempts = 2 * urcu_spin_exit_loops;
+}
+
+#endif /* _URCU_SPIN_IMPL_H */
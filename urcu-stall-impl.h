@@ -0,0 +1,171 @@
+#ifndef _URCU_STALL_IMPL_H
+#define _URCU_STALL_IMPL_H
+
+/*
+ * urcu-stall-impl.h
+ *
+ * Userspace RCU library - grace period stall detection
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/*
+ * The waiting loop of the including flavor keeps a struct
+ * urcu_stall_check for the grace period. While readers are still
+ * awaited, it checks urcu_stall_check_due(), and if so calls
+ * urcu_stall_report() for each of them, with the registry lock held.
+ * Sleeping waits are bounded by urcu_stall_check_timeout(), so a
+ * reader stuck forever is still reported.
+ *
+ * When stall detection is disabled, the only cost is a test of
+ * check->start per waiting loop.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+
+#include <urcu/compiler.h>
+#include <urcu/system.h>
+
+#include "urcu-die.h"
+#include "urcu-stall.h"
+
+/*
+ * rcu_stall_lock protects the report callback against concurrent
+ * rcu_set_stall_timeout().
+ */
+static pthread_mutex_t rcu_stall_lock = PTHREAD_MUTEX_INITIALIZER;
+static unsigned int rcu_stall_timeout_ms;
+static void (*rcu_stall_fn)(const struct rcu_stall_reader *reader, void *priv);
+static void *rcu_stall_priv;
+
+struct urcu_stall_check {
+	const char *flavor;
+	uint64_t start;		/* Start of the wait, 0 if detection is disabled */
+	uint64_t next;		/* Time of the next report */
+	uint64_t timeout_ns;
+};
+
+static inline uint64_t urcu_stall_now(void)
+{
+	struct timespec ts;
+
+	if (clock_gettime(CLOCK_MONOTONIC, &ts))
+		urcu_die(errno);
+	return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+void rcu_set_stall_timeout(unsigned int timeout_ms,
+		void (*fn)(const struct rcu_stall_reader *reader, void *priv),
+		void *priv)
+{
+	int ret;
+
+	ret = pthread_mutex_lock(&rcu_stall_lock);
+	if (ret)
+		urcu_die(ret);
+	rcu_stall_fn = fn;
+	rcu_stall_priv = priv;
+	CMM_STORE_SHARED(rcu_stall_timeout_ms, timeout_ms);
+	ret = pthread_mutex_unlock(&rcu_stall_lock);
+	if (ret)
+		urcu_die(ret);
+}
+
+/*
+ * Called when a grace period starts waiting for readers.
+ */
+static inline void urcu_stall_check_init(struct urcu_stall_check *check,
+		const char *flavor)
+{
+	unsigned int timeout_ms = CMM_LOAD_SHARED(rcu_stall_timeout_ms);
+
+	check->flavor = flavor;
+	if (caa_likely(!timeout_ms)) {
+		check->start = check->next = check->timeout_ns = 0;
+		return;
+	}
+	check->timeout_ns = timeout_ms * 1000000ULL;
+	check->start = urcu_stall_now();
+	check->next = check->start + check->timeout_ns;
+}
+
+/*
+ * Returns nonzero if the readers still awaited should be reported now,
+ * in which case the next report is due a stall timeout later.
+ */
+static inline int urcu_stall_check_due(struct urcu_stall_check *check)
+{
+	uint64_t now;
+
+	if (caa_likely(!check->start))
+		return 0;
+	now = urcu_stall_now();
+	if (now < check->next)
+		return 0;
+	check->next = now + check->timeout_ns;
+	return 1;
+}
+
+/*
+ * Relative timeout until the next report is due, for sleeping waits.
+ * Returns NULL, an infinite timeout, if detection is disabled.
+ */
+static inline const struct timespec *
+urcu_stall_check_timeout(struct urcu_stall_check *check, struct timespec *ts)
+{
+	uint64_t now, delta = 0;
+
+	if (caa_likely(!check->start))
+		return NULL;
+	now = urcu_stall_now();
+	if (check->next > now)
+		delta = check->next - now;
+	ts->tv_sec = delta / 1000000000ULL;
+	ts->tv_nsec = delta % 1000000000ULL;
+	return ts;
+}
+
+static inline void urcu_stall_report(struct urcu_stall_check *check,
+		pthread_t tid, unsigned long nesting)
+{
+	struct rcu_stall_reader reader;
+	int ret;
+
+	reader.tid = tid;
+	reader.flavor = check->flavor;
+	reader.nesting = nesting;
+	reader.stall_ns = urcu_stall_now() - check->start;
+
+	ret = pthread_mutex_lock(&rcu_stall_lock);
+	if (ret)
+		urcu_die(ret);
+	if (rcu_stall_fn)
+		rcu_stall_fn(&reader, rcu_stall_priv);
+	else
+		fprintf(stderr, "[liburcu-%s] grace period stalled for %llu ms "
+			"by reader thread %lx, nesting %lu\n",
+			reader.flavor,
+			(unsigned long long) reader.stall_ns / 1000000ULL,
+			(unsigned long) reader.tid, reader.nesting);
+	ret = pthread_mutex_unlock(&rcu_stall_lock);
+	if (ret)
+		urcu_die(ret);
+}
+
+#endif /* _URCU_STALL_IMPL_H */
@@ -0,0 +1,74 @@
+#ifndef _URCU_STALL_H
+#define _URCU_STALL_H
+
+/*
+ * urcu-stall.h
+ *
+ * Userspace RCU header - grace period stall detection
+ *
+ * LGPL-compatible code should include this header with :
+ *
+ * #define _LGPL_SOURCE
+ * #include <urcu.h>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include <stdint.h>
+#include <pthread.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * A registered reader thread holding up a grace period for longer than
+ * the stall timeout.
+ */
+struct rcu_stall_reader {
+	pthread_t tid;
+	const char *flavor;	/* "memb", "mb", "signal", "qsbr" or "bp" */
+	/*
+	 * Read-side critical section nesting level. Always 0 for the QSBR
+	 * flavor, where the reader is online without having reported a
+	 * quiescent state.
+	 */
+	unsigned long nesting;
+	/*
+	 * Time the grace period has been waiting for the reader. The
+	 * reader has been in its critical section for at least as long.
+	 */
+	uint64_t stall_ns;
+};
+
+/*
+ * Important: see rcu-api.txt in userspace-rcu documentation for
+ * stall detection usage detail.
+ *
+ * When a grace period has been waiting for more than timeout_ms
+ * milliseconds, call fn() for each reader it still waits for, and
+ * again every timeout_ms milliseconds while the grace period lasts.
+ * If fn is NULL, readers are reported on stderr. A timeout_ms of 0,
+ * the default, disables stall detection.
+ */
+extern void rcu_set_stall_timeout(unsigned int timeout_ms,
+		void (*fn)(const struct rcu_stall_reader *reader, void *priv),
+		void *priv);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _URCU_STALL_H */
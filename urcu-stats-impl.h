@@ -0,0 +1,131 @@
+#ifndef _URCU_STATS_IMPL_H
+#define _URCU_STATS_IMPL_H
+
+/*
+ * urcu-stats-impl.h
+ *
+ * Userspace RCU library - grace period and callback statistics
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/*
+ * The including flavor calls urcu_stats_gp_begin() and
+ * urcu_stats_gp_end() around each grace period, and
+ * urcu_stats_scanned() and urcu_stats_sleep() while waiting for
+ * readers, all with rcu_gp_lock held. Grace periods being serialized,
+ * the counts of the current one are kept in plain variables, and only
+ * published once it completes, within a sequence count write section,
+ * so rcu_get_stats() reads a consistent snapshot without taking
+ * rcu_gp_lock. The call_rcu statistics are kept in each call_rcu_data
+ * structure by urcu-call-rcu-impl.h.
+ */
+
+#include <stdint.h>
+#include <errno.h>
+#include <time.h>
+
+#include <urcu/compiler.h>
+#include <urcu/arch.h>
+#include <urcu/system.h>
+
+#include "urcu-die.h"
+#include "urcu-stats.h"
+
+/* Counts of the current grace period, protected by rcu_gp_lock. */
+static struct {
+	uint64_t start;
+	unsigned long readers_scanned;
+	unsigned long sleeps;
+} urcu_stats_gp;
+
+/* Odd while urcu_stats is being updated. */
+static unsigned long urcu_stats_seq;
+static struct rcu_stats urcu_stats;
+
+/* Defined by urcu-call-rcu-impl.h. */
+static void call_rcu_get_stats(struct rcu_stats *stats);
+
+static inline uint64_t urcu_stats_now(void)
+{
+	struct timespec ts;
+
+	if (clock_gettime(CLOCK_MONOTONIC, &ts))
+		urcu_die(errno);
+	return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static inline void urcu_stats_gp_begin(void)
+{
+	urcu_stats_gp.start = urcu_stats_now();
+	urcu_stats_gp.readers_scanned = 0;
+	urcu_stats_gp.sleeps = 0;
+}
+
+/* Reader counters checked once more. */
+static inline void urcu_stats_scanned(unsigned long nr_readers)
+{
+	urcu_stats_gp.readers_scanned += nr_readers;
+}
+
+/* Sleeping wait for readers. */
+static inline void urcu_stats_sleep(void)
+{
+	urcu_stats_gp.sleeps++;
+}
+
+static inline void urcu_stats_gp_end(int expedited)
+{
+	uint64_t latency = urcu_stats_now() - urcu_stats_gp.start;
+
+	CMM_STORE_SHARED(urcu_stats_seq, urcu_stats_seq + 1);
+	/* Write sequence count before statistics. */
+	cmm_smp_wmb();
+	urcu_stats.gp_count++;
+	if (expedited)
+		urcu_stats.gp_expedited++;
+	urcu_stats.gp_readers_scanned += urcu_stats_gp.readers_scanned;
+	urcu_stats.gp_sleeps += urcu_stats_gp.sleeps;
+	urcu_stats.gp_latency_total_ns += latency;
+	if (latency > urcu_stats.gp_latency_max_ns)
+		urcu_stats.gp_latency_max_ns = latency;
+	urcu_stats.gp_latency_hist[rcu_stats_latency_bucket(latency)]++;
+	/* Write statistics before sequence count. */
+	cmm_smp_wmb();
+	CMM_STORE_SHARED(urcu_stats_seq, urcu_stats_seq + 1);
+}
+
+void rcu_get_stats(struct rcu_stats *stats)
+{
+	unsigned long seq;
+
+	for (;;) {
+		seq = CMM_LOAD_SHARED(urcu_stats_seq);
+		if (seq & 1) {
+			caa_cpu_relax();
+			continue;
+		}
+		/* Read sequence count before statistics. */
+		cmm_smp_rmb();
+		*stats = urcu_stats;
+		/* Read statistics before checking sequence count. */
+		cmm_smp_rmb();
+		if (CMM_LOAD_SHARED(urcu_stats_seq) == seq)
+			break;
+	}
+	call_rcu_get_stats(stats);
+}
+
+#endif /* _URCU_STATS_IMPL_H */
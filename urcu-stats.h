@@ -0,0 +1,103 @@
+#ifndef _URCU_STATS_H
+#define _URCU_STATS_H
+
+/*
+ * urcu-stats.h
+ *
+ * Userspace RCU header - grace period and callback statistics
+ *
+ * LGPL-compatible code should include this header with :
+ *
+ * #define _LGPL_SOURCE
+ * #include <urcu.h>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Grace period latencies are counted in log-linear buckets: each power
+ * of 2 is split in 1 << RCU_STATS_LATENCY_SUB_BITS buckets, so a bucket
+ * spans at most 25% of its lower bound, from 1ns up to 2^64ns.
+ */
+#define RCU_STATS_LATENCY_SUB_BITS	2
+#define RCU_STATS_LATENCY_BUCKETS	\
+	((64 - RCU_STATS_LATENCY_SUB_BITS + 1) << RCU_STATS_LATENCY_SUB_BITS)
+
+struct rcu_stats {
+	/* Grace periods */
+	unsigned long long gp_count;		/* Completed grace periods */
+	unsigned long long gp_expedited;	/* ... of which expedited */
+	unsigned long long gp_readers_scanned;	/* Reader counters checked */
+	unsigned long long gp_sleeps;		/* Sleeps waiting for readers */
+	unsigned long long gp_latency_total_ns;
+	unsigned long long gp_latency_max_ns;
+	unsigned long long gp_latency_hist[RCU_STATS_LATENCY_BUCKETS];
+	/* call_rcu */
+	unsigned long call_rcu_data_count;	/* call_rcu_data structures */
+	unsigned long call_rcu_qlen;		/* Callbacks waiting */
+	unsigned long long call_rcu_invoked;	/* Callbacks invoked */
+};
+
+/*
+ * Important: see rcu-api.txt in userspace-rcu documentation for
+ * statistics usage detail.
+ *
+ * Fill *stats with the statistics of the flavor since the program
+ * started. Does not wait for grace periods in progress.
+ */
+extern void rcu_get_stats(struct rcu_stats *stats);
+
+/* Index of the latency histogram bucket counting a latency of ns. */
+static inline unsigned int rcu_stats_latency_bucket(uint64_t ns)
+{
+	unsigned int msb;
+
+	if (ns < (1U << RCU_STATS_LATENCY_SUB_BITS))
+		return ns;
+#ifdef __GNUC__
+	msb = 63 - __builtin_clzll(ns);
+#else
+	for (msb = 63; !(ns >> msb); msb--)
+		;
+#endif
+	return ((msb - RCU_STATS_LATENCY_SUB_BITS + 1)
+			<< RCU_STATS_LATENCY_SUB_BITS)
+		| ((ns >> (msb - RCU_STATS_LATENCY_SUB_BITS))
+			& ((1U << RCU_STATS_LATENCY_SUB_BITS) - 1));
+}
+
+/* Lowest latency, in ns, counted by latency histogram bucket "bucket". */
+static inline uint64_t rcu_stats_latency_bucket_floor(unsigned int bucket)
+{
+	unsigned int shift = bucket >> RCU_STATS_LATENCY_SUB_BITS;
+
+	if (!shift)
+		return bucket;
+	return (uint64_t) ((1U << RCU_STATS_LATENCY_SUB_BITS)
+			| (bucket & ((1U << RCU_STATS_LATENCY_SUB_BITS) - 1)))
+		<< (shift - 1);
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _URCU_STATS_H */
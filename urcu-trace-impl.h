@@ -0,0 +1,258 @@
+#ifndef _URCU_TRACE_IMPL_H
+#define _URCU_TRACE_IMPL_H
+
+/*
+ * urcu-trace-impl.h
+ *
+ * Userspace RCU library - grace period and callback event tracing
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/*
+ * The including flavor defines RCU_FLAVOR_NAME, and records events
+ * with urcu_trace(), which compiles to nothing unless CONFIG_RCU_TRACE
+ * is defined.
+ *
+ * Each thread recording events owns a ring buffer, allocated on its
+ * first event. Only the owner writes to it, without atomic operation:
+ * it fills the record at "head", then publishes it by incrementing
+ * "head". Readers copy records and check "head" again afterwards: a
+ * record copied while the owner may have been overwriting it is
+ * dropped. The buffer of an exiting thread stays readable until a new
+ * thread reuses it. Buffers are never freed.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+
+#include <urcu/compiler.h>
+#include <urcu/arch.h>
+#include <urcu/system.h>
+#include <urcu/list.h>
+#include <urcu/tls-compat.h>
+#include <urcu/config.h>
+
+#include "urcu-die.h"
+#include "urcu-trace.h"
+
+#ifdef CONFIG_RCU_TRACE
+
+/* Records per thread ring buffer. Must be a power of 2. */
+#define URCU_TRACE_RECORDS	1024
+
+struct urcu_trace_record {
+	uint64_t timestamp;
+	unsigned long arg;
+	unsigned int type;
+};
+
+struct urcu_trace_buf {
+	struct cds_list_head node;
+	pthread_t tid;
+	int owned;			/* Owned by a live thread */
+	unsigned long head;		/* Records written so far */
+	struct urcu_trace_record records[URCU_TRACE_RECORDS];
+};
+
+/* Protects the buffer list, and buffer ownership. */
+static pthread_mutex_t urcu_trace_lock = PTHREAD_MUTEX_INITIALIZER;
+static CDS_LIST_HEAD(urcu_trace_bufs);
+static pthread_key_t urcu_trace_key;
+static pthread_once_t urcu_trace_key_once = PTHREAD_ONCE_INIT;
+static int urcu_trace_key_created;
+static DEFINE_URCU_TLS(struct urcu_trace_buf *, urcu_trace_buf);
+
+static void urcu_trace_mutex_lock(void)
+{
+	int ret;
+
+	ret = pthread_mutex_lock(&urcu_trace_lock);
+	if (ret)
+		urcu_die(ret);
+}
+
+static void urcu_trace_mutex_unlock(void)
+{
+	int ret;
+
+	ret = pthread_mutex_unlock(&urcu_trace_lock);
+	if (ret)
+		urcu_die(ret);
+}
+
+/* Hand the buffer of an exiting thread over to the next new thread. */
+static void urcu_trace_thread_exit(void *arg)
+{
+	struct urcu_trace_buf *buf = arg;
+
+	urcu_trace_mutex_lock();
+	buf->owned = 0;
+	urcu_trace_mutex_unlock();
+	/* Events recorded by later destructors need a new buffer. */
+	URCU_TLS(urcu_trace_buf) = NULL;
+}
+
+static void urcu_trace_create_key(void)
+{
+	int ret;
+
+	ret = pthread_key_create(&urcu_trace_key, urcu_trace_thread_exit);
+	if (ret)
+		urcu_die(ret);
+	urcu_trace_key_created = 1;
+}
+
+/*
+ * Called from the flavor destructor: do not run our thread exit
+ * function once the library is unloaded.
+ */
+static void urcu_trace_exit(void)
+{
+	if (urcu_trace_key_created)
+		pthread_key_delete(urcu_trace_key);
+}
+
+static struct urcu_trace_buf *urcu_trace_buf_get(void)
+{
+	struct urcu_trace_buf *buf;
+	int ret;
+
+	ret = pthread_once(&urcu_trace_key_once, urcu_trace_create_key);
+	if (ret)
+		urcu_die(ret);
+	urcu_trace_mutex_lock();
+	cds_list_for_each_entry(buf, &urcu_trace_bufs, node) {
+		if (!buf->owned)
+			goto found;
+	}
+	buf = malloc(sizeof(*buf));
+	if (!buf)
+		urcu_die(ENOMEM);
+	cds_list_add_tail(&buf->node, &urcu_trace_bufs);
+found:
+	buf->tid = pthread_self();
+	buf->owned = 1;
+	buf->head = 0;
+	urcu_trace_mutex_unlock();
+	ret = pthread_setspecific(urcu_trace_key, buf);
+	if (ret)
+		urcu_die(ret);
+	URCU_TLS(urcu_trace_buf) = buf;
+	return buf;
+}
+
+static void urcu_trace(enum rcu_trace_type type, unsigned long arg)
+{
+	struct urcu_trace_buf *buf = URCU_TLS(urcu_trace_buf);
+	struct urcu_trace_record *rec;
+	struct timespec ts;
+
+	if (caa_unlikely(!buf))
+		buf = urcu_trace_buf_get();
+	rec = &buf->records[buf->head & (URCU_TRACE_RECORDS - 1)];
+	(void) clock_gettime(CLOCK_MONOTONIC, &ts);
+	rec->timestamp = (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+	rec->arg = arg;
+	rec->type = type;
+	/* Write record before publishing it. */
+	cmm_smp_wmb();
+	CMM_STORE_SHARED(buf->head, buf->head + 1);
+}
+
+void rcu_trace_for_each_event(
+		void (*fn)(const struct rcu_trace_event *event, void *priv),
+		void *priv)
+{
+	struct urcu_trace_record rec;
+	struct rcu_trace_event event;
+	struct urcu_trace_buf *buf;
+	unsigned long i, head;
+
+	event.flavor = RCU_FLAVOR_NAME;
+	urcu_trace_mutex_lock();
+	cds_list_for_each_entry(buf, &urcu_trace_bufs, node) {
+		event.tid = buf->tid;
+		head = CMM_LOAD_SHARED(buf->head);
+		i = head > URCU_TRACE_RECORDS ? head - URCU_TRACE_RECORDS : 0;
+		for (; i < head; i++) {
+			/* Read head before record. */
+			cmm_smp_rmb();
+			rec = buf->records[i & (URCU_TRACE_RECORDS - 1)];
+			/* Read record before checking it was not reused. */
+			cmm_smp_rmb();
+			if (i + URCU_TRACE_RECORDS <= CMM_LOAD_SHARED(buf->head))
+				continue;
+			event.timestamp = rec.timestamp;
+			event.type = rec.type;
+			event.arg = rec.arg;
+			fn(&event, priv);
+		}
+	}
+	urcu_trace_mutex_unlock();
+}
+
+#else /* #ifdef CONFIG_RCU_TRACE */
+
+static inline void urcu_trace(enum rcu_trace_type type, unsigned long arg)
+{
+}
+
+static inline void urcu_trace_exit(void)
+{
+}
+
+void rcu_trace_for_each_event(
+		void (*fn)(const struct rcu_trace_event *event, void *priv),
+		void *priv)
+{
+}
+
+#endif /* #else #ifdef CONFIG_RCU_TRACE */
+
+static const char *urcu_trace_names[NR_RCU_TRACE_TYPES] = {
+	[RCU_TRACE_GP_BEGIN] = "gp_begin",
+	[RCU_TRACE_GP_END] = "gp_end",
+	[RCU_TRACE_GP_PHASE] = "gp_phase",
+	[RCU_TRACE_GP_SLEEP] = "gp_sleep",
+	[RCU_TRACE_GP_WAKEUP] = "gp_wakeup",
+	[RCU_TRACE_CALL_RCU] = "call_rcu",
+	[RCU_TRACE_CALL_RCU_BATCH_BEGIN] = "call_rcu_batch_begin",
+	[RCU_TRACE_CALL_RCU_BATCH_END] = "call_rcu_batch_end",
+	[RCU_TRACE_DEFER_BARRIER_BEGIN] = "defer_barrier_begin",
+	[RCU_TRACE_DEFER_BARRIER_END] = "defer_barrier_end",
+};
+
+static void urcu_trace_print(const struct rcu_trace_event *event, void *priv)
+{
+	FILE *fp = priv;
+
+	fprintf(fp, "%llu.%09llu %s %lx %s %lu\n",
+		(unsigned long long) event->timestamp / 1000000000ULL,
+		(unsigned long long) event->timestamp % 1000000000ULL,
+		event->flavor, (unsigned long) event->tid,
+		urcu_trace_names[event->type], event->arg);
+}
+
+void rcu_trace_dump(FILE *fp)
+{
+	rcu_trace_for_each_event(urcu_trace_print, fp);
+}
+
+#endif /* _URCU_TRACE_IMPL_H */
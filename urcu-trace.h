@@ -0,0 +1,86 @@
+#ifndef _URCU_TRACE_H
+#define _URCU_TRACE_H
+
+/*
+ * urcu-trace.h
+ *
+ * Userspace RCU header - grace period and callback event tracing
+ *
+ * LGPL-compatible code should include this header with :
+ *
+ * #define _LGPL_SOURCE
+ * #include <urcu.h>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <pthread.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Events are only recorded when the library is configured with
+ * --enable-rcu-trace. The meaning of the event argument is given for
+ * each type.
+ */
+enum rcu_trace_type {
+	RCU_TRACE_GP_BEGIN,		/* synchronize_rcu() starts a grace period. arg: expedited */
+	RCU_TRACE_GP_END,		/* Grace period completed. arg: expedited */
+	RCU_TRACE_GP_PHASE,		/* Readers of one phase are done. arg: wait loops */
+	RCU_TRACE_GP_SLEEP,		/* Grace period sleeps waiting for readers. */
+	RCU_TRACE_GP_WAKEUP,		/* Grace period wakes up. */
+	RCU_TRACE_CALL_RCU,		/* call_rcu() queues a callback. arg: queue length */
+	RCU_TRACE_CALL_RCU_BATCH_BEGIN,	/* call_rcu thread takes a batch. arg: queue length */
+	RCU_TRACE_CALL_RCU_BATCH_END,	/* Batch callbacks invoked. arg: callbacks */
+	RCU_TRACE_DEFER_BARRIER_BEGIN,	/* rcu_defer_barrier*() starts. arg: callbacks */
+	RCU_TRACE_DEFER_BARRIER_END,	/* Deferred callbacks invoked. arg: callbacks */
+	NR_RCU_TRACE_TYPES,
+};
+
+struct rcu_trace_event {
+	uint64_t timestamp;	/* CLOCK_MONOTONIC, in ns */
+	pthread_t tid;		/* Thread which recorded the event */
+	const char *flavor;	/* "memb", "mb", "signal", "qsbr", "bp" or "percpu" */
+	enum rcu_trace_type type;
+	unsigned long arg;
+};
+
+/*
+ * Important: see rcu-api.txt in userspace-rcu documentation for
+ * tracing usage detail.
+ *
+ * Call fn() for each event held in the ring buffers of the flavor,
+ * in recording order for each thread. fn() is called with the buffer
+ * list lock held: it must not call into the RCU library.
+ */
+extern void rcu_trace_for_each_event(
+		void (*fn)(const struct rcu_trace_event *event, void *priv),
+		void *priv);
+
+/*
+ * Print the events held in the ring buffers of the flavor to fp, one
+ * per line.
+ */
+extern void rcu_trace_dump(FILE *fp);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _URCU_TRACE_H */
@@ -0,0 +1,261 @@
+#ifndef _URCU_WAIT_H
+#define _URCU_WAIT_H
+
+/*
+ * urcu-wait.h
+ *
+ * Userspace RCU library wait/wakeup management
+ *
+ * Copyright (c) 2012 Mathieu Desnoyers <mathieu.desnoyers@efficios.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include <assert.h>
+#include <poll.h>
+#include <stdint.h>
+#include <urcu/compiler.h>
+#include <urcu/arch.h>
+#include <urcu/uatomic.h>
+#include <urcu/futex.h>
+
+/*
+ * Number of busy-loop attempts before waiting on futex for grace period
+ * batching.
+ */
+#define URCU_WAIT_ATTEMPTS	1000
+
+/*
+ * Number of busy-loop attempts before sleeping while waiting for a
+ * concurrent enqueuer to link its wait node.
+ */
+#define URCU_WAIT_ADAPT_ATTEMPTS	10
+#define URCU_WAIT_SLEEP		10	/* Sleep 10 ms if being linked */
+
+/* Marks the end of a wait queue. */
+#define URCU_WAIT_QUEUE_END	((struct urcu_wait_node *) 0x1UL)
+
+enum urcu_wait_state {
+	/* URCU_WAIT_WAITING is compared directly (futex compares it). */
+	URCU_WAIT_WAITING =	0,
+	/* non-zero are used as masks. */
+	URCU_WAIT_WAKEUP =	(1 << 0),
+	URCU_WAIT_RUNNING =	(1 << 1),
+	URCU_WAIT_TEARDOWN =	(1 << 2),
+};
+
+/*
+ * Wait node, typically allocated on the stack of the waiting thread.
+ * "next" is NULL until the enqueuer links it into the queue.
+ */
+struct urcu_wait_node {
+	struct urcu_wait_node *next;
+	int32_t state;
+};
+
+#define URCU_WAIT_NODE_INIT(name, _state)		\
+	{ .next = NULL, .state = _state }
+
+#define DEFINE_URCU_WAIT_NODE(name, state)		\
+	struct urcu_wait_node name = URCU_WAIT_NODE_INIT(name, state)
+
+/*
+ * Wait queue: wait-free push, pop of the entire queue by xchg. Nodes
+ * are linked in LIFO order.
+ */
+struct urcu_wait_queue {
+	struct urcu_wait_node *head;
+};
+
+#define URCU_WAIT_QUEUE_HEAD_INIT(name)			\
+	{ .head = URCU_WAIT_QUEUE_END }
+
+#define DEFINE_URCU_WAIT_QUEUE(name)			\
+	struct urcu_wait_queue name = URCU_WAIT_QUEUE_HEAD_INIT(name)
+
+/*
+ * List of waiters grabbed from a wait queue, owned by a single thread.
+ */
+struct urcu_waiters {
+	struct urcu_wait_node *head;
+};
+
+/*
+ * Add ourself atomically to a wait queue. Return 0 if queue was
+ * previously empty, else return 1.
+ * A full memory barrier is issued before being added to the wait queue.
+ */
+static inline
+int urcu_wait_add(struct urcu_wait_queue *queue,
+		struct urcu_wait_node *node)
+{
+	struct urcu_wait_node *old_head;
+
+	/*
+	 * uatomic_xchg() implicit memory barrier orders earlier stores
+	 * to node (and to memory accessed by the waiter) before
+	 * publication.
+	 */
+	old_head = uatomic_xchg(&queue->head, node);
+	/*
+	 * At this point, the thread grabbing the queue sees a NULL
+	 * node->next, and busy-waits until it is set to old_head.
+	 */
+	CMM_STORE_SHARED(node->next, old_head);
+	return old_head != URCU_WAIT_QUEUE_END;
+}
+
+/*
+ * Atomically move all waiters from wait queue into our local struct
+ * urcu_waiters.
+ */
+static inline
+void urcu_move_waiters(struct urcu_waiters *waiters,
+		struct urcu_wait_queue *queue)
+{
+	waiters->head = uatomic_xchg(&queue->head, URCU_WAIT_QUEUE_END);
+}
+
+static inline
+void urcu_wait_set_state(struct urcu_wait_node *node,
+		enum urcu_wait_state state)
+{
+	node->state = state;
+}
+
+/*
+ * Waiting for the enqueuer to link the node, and return the next node.
+ */
+static inline
+struct urcu_wait_node *urcu_wait_node_sync_next(struct urcu_wait_node *node)
+{
+	struct urcu_wait_node *next;
+	int attempt = 0;
+
+	/*
+	 * Adaptative busy-looping waiting for enqueuer to complete push.
+	 */
+	while ((next = CMM_LOAD_SHARED(node->next)) == NULL) {
+		if (++attempt >= URCU_WAIT_ADAPT_ATTEMPTS) {
+			poll(NULL, 0, URCU_WAIT_SLEEP);
+			attempt = 0;
+		} else {
+			caa_cpu_relax();
+		}
+	}
+	return next;
+}
+
+/*
+ * Note: urcu_adaptative_wake_up needs "value" to stay allocated
+ * throughout its execution. In this scheme, the waiter owns the node
+ * memory, and we only allow it to free this memory when it receives the
+ * URCU_WAIT_TEARDOWN flag.
+ */
+static inline
+void urcu_adaptative_wake_up(struct urcu_wait_node *wait)
+{
+	cmm_smp_mb();
+	assert(uatomic_read(&wait->state) == URCU_WAIT_WAITING);
+	uatomic_set(&wait->state, URCU_WAIT_WAKEUP);
+	if (!(uatomic_read(&wait->state) & URCU_WAIT_RUNNING))
+		futex_noasync(&wait->state, FUTEX_WAKE, 1, NULL, NULL, 0);
+	/* Allow teardown of struct urcu_wait memory. */
+	uatomic_or(&wait->state, URCU_WAIT_TEARDOWN);
+}
+
+/*
+ * Called by a woken up waiter: wait until the waker lets us tear down
+ * the wait node memory.
+ */
+static inline
+void urcu_wait_teardown_sync(struct urcu_wait_node *wait)
+{
+	unsigned int i;
+
+	/* Tell waker thread than we are running. */
+	uatomic_or(&wait->state, URCU_WAIT_RUNNING);
+
+	/*
+	 * Wait until waker thread lets us know it's ok to tear down
+	 * memory allocated for struct urcu_wait.
+	 */
+	for (i = 0; i < URCU_WAIT_ATTEMPTS; i++) {
+		if (uatomic_read(&wait->state) & URCU_WAIT_TEARDOWN)
+			break;
+		caa_cpu_relax();
+	}
+	while (!(uatomic_read(&wait->state) & URCU_WAIT_TEARDOWN))
+		poll(NULL, 0, 10);
+	assert(uatomic_read(&wait->state) & URCU_WAIT_TEARDOWN);
+}
+
+/*
+ * Caller must initialize "value" to URCU_WAIT_WAITING before passing its
+ * memory to waker thread.
+ */
+static inline
+void urcu_adaptative_busy_wait(struct urcu_wait_node *wait)
+{
+	unsigned int i;
+
+	/* Load and test condition before read state */
+	cmm_smp_rmb();
+	for (i = 0; i < URCU_WAIT_ATTEMPTS; i++) {
+		if (uatomic_read(&wait->state) != URCU_WAIT_WAITING)
+			goto skip_futex_wait;
+		caa_cpu_relax();
+	}
+	while (uatomic_read(&wait->state) == URCU_WAIT_WAITING)
+		futex_noasync(&wait->state, FUTEX_WAIT, URCU_WAIT_WAITING,
+			NULL, NULL, 0);
+skip_futex_wait:
+	urcu_wait_teardown_sync(wait);
+}
+
+/*
+ * Same as urcu_adaptative_busy_wait(), but never sleeps on the futex:
+ * for waiters which favor wake up latency over CPU time.
+ */
+static inline
+void urcu_busy_wait(struct urcu_wait_node *wait)
+{
+	/* Load and test condition before read state */
+	cmm_smp_rmb();
+	while (uatomic_read(&wait->state) == URCU_WAIT_WAITING)
+		caa_cpu_relax();
+	urcu_wait_teardown_sync(wait);
+}
+
+/*
+ * Wake up all waiters moved into "waiters", except those already
+ * running (e.g. the thread which grabbed the queue).
+ */
+static inline
+void urcu_wake_all_waiters(struct urcu_waiters *waiters)
+{
+	struct urcu_wait_node *iter, *next;
+
+	for (iter = waiters->head; iter != URCU_WAIT_QUEUE_END; iter = next) {
+		/* Read next before waking up: node memory is then freed. */
+		next = urcu_wait_node_sync_next(iter);
+		/* Don't wake already running threads */
+		if (iter->state & URCU_WAIT_RUNNING)
+			continue;
+		urcu_adaptative_wake_up(iter);
+	}
+}
+
+#endif /* _URCU_WAIT_H */
@@ -43,6 +43,8 @@
 #include "urcu/tls-compat.h"
 
 #include "urcu-die.h"
+#include "urcu-wait.h"
+#include "urcu-reader-slab.h"
 
 /* Do not #define _LGPL_SOURCE to ensure we can emit the wrapper symbols */
 #undef _LGPL_SOURCE
@@ -57,13 +59,29 @@
 #define KICK_READER_LOOPS 10000
 
 /*
- * Active attempts to check for reader Q.S. before calling futex().
+ * Initial active attempts to check for reader Q.S. before calling futex(),
+ * adapted to the readers at runtime by urcu-spin-impl.h.
  */
 #define RCU_QS_ACTIVE_ATTEMPTS 100
 
+#if defined(RCU_MEMBARRIER)
+#define RCU_FLAVOR_NAME	"memb"
+#elif defined(RCU_SIGNAL)
+#define RCU_FLAVOR_NAME	"signal"
+#else
+#define RCU_FLAVOR_NAME	"mb"
+#endif
+
+#include "urcu-stall-impl.h"
+#include "urcu-trace-impl.h"
+#include "urcu-stats-impl.h"
+#include "urcu-spin-impl.h"
+
 #ifdef RCU_MEMBARRIER
 static int init_done;
 int has_sys_membarrier;
+/* membarrier(2) command issued by smp_mb_master(). */
+static int membarrier_cmd;
 
 void __attribute__((constructor)) rcu_init(void);
 #endif
@@ -78,10 +96,26 @@ void rcu_init(void)
 static int init_done;
 
 void __attribute__((constructor)) rcu_init(void);
-void __attribute__((destructor)) rcu_exit(void);
 #endif
 
+void __attribute__((destructor)) rcu_exit(void);
+
+/*
+ * rcu_gp_lock ensures mutual exclusion between threads calling
+ * synchronize_rcu().
+ */
 static pthread_mutex_t rcu_gp_lock = PTHREAD_MUTEX_INITIALIZER;
+/*
+ * rcu_registry_lock ensures mutual exclusion between threads
+ * registering and unregistering themselves to/from the registry, and
+ * with threads reading that registry from synchronize_rcu(). However,
+ * this lock is not held all the way through the completion of awaiting
+ * for the grace period. It is sporadically released between iterations
+ * on the registry, so thread registration and unregistration do not
+ * have to wait for a whole grace period to complete.
+ * rcu_registry_lock may nest inside rcu_gp_lock.
+ */
+static pthread_mutex_t rcu_registry_lock = PTHREAD_MUTEX_INITIALIZER;
 
 int32_t gp_futex;
 
@@ -106,6 +140,30 @@ DEFINE_URCU_TLS(unsigned int, rand_yield);
 
 static CDS_LIST_HEAD(registry);
 
+#ifdef CONFIG_RCU_READER_SLAB
+/* Reader counters, scanned by synchronize_rcu(). */
+static struct urcu_reader_slab *reader_slabs;
+#endif
+
+/*
+ * Grace period sequence number for the polling API. Odd while a grace
+ * period is in progress. Written to only by writer with mutex taken.
+ */
+static unsigned long rcu_gp_seq;
+
+/*
+ * Queue keeping threads awaiting to wait for a grace period. Contains
+ * struct urcu_wait_node objects, allocated on the waiters' stacks.
+ */
+static DEFINE_URCU_WAIT_QUEUE(gp_waiters);
+
+/*
+ * Number of synchronize_rcu_expedited() calls in progress. While
+ * non-zero, grace periods busy-wait for readers instead of sleeping on
+ * gp_futex.
+ */
+static int gp_expedited;
+
 static void mutex_lock(pthread_mutex_t *mutex)
 {
 	int ret;
@@ -140,10 +198,12 @@ static void mutex_unlock(pthread_mutex_t *mutex)
 #ifdef RCU_MEMBARRIER
 static void smp_mb_master(int group)
 {
-	if (caa_likely(has_sys_membarrier))
-		membarrier(MEMBARRIER_EXPEDITED);
-	else
+	if (caa_likely(has_sys_membarrier)) {
+		if (membarrier(membarrier_cmd, 0))
+			urcu_die(errno);
+	} else {
 		cmm_smp_mb();
+	}
 }
 #endif
 
@@ -203,26 +263,117 @@ static void smp_mb_master(int group)
 }
 #endif /* #ifdef RCU_SIGNAL */
 
+static unsigned long *reader_ctr(struct rcu_reader *index)
+{
+#ifdef CONFIG_RCU_READER_SLAB
+	return index->ctr;
+#else
+	return &index->ctr;
+#endif
+}
+
+/*
+ * Report the readers the grace period is still waiting for. Called
+ * with the registry lock held.
+ */
+static void report_stalled_readers(struct urcu_stall_check *stall)
+{
+	struct rcu_reader *index;
+	unsigned long ctr;
+
+	cds_list_for_each_entry(index, &registry, node) {
+		ctr = CMM_LOAD_SHARED(*reader_ctr(index));
+		if (!rcu_gp_ongoing(&ctr))
+			continue;
+		urcu_stall_report(stall, index->tid,
+			(ctr & RCU_GP_CTR_NEST_MASK) / RCU_GP_COUNT);
+	}
+}
+
 /*
  * synchronize_rcu() waiting. Single thread.
+ * Always called with rcu_registry lock held. Releases this lock and
+ * grabs it again. Holds the lock when it returns.
  */
-static void wait_gp(void)
+static void wait_gp(struct urcu_stall_check *stall)
 {
-	/* Read reader_gp before read futex */
+	struct timespec timeout;
+
+	/*
+	 * Read reader_gp before read futex. smp_mb_master() needs to
+	 * be called with the rcu registry lock held in RCU_SIGNAL
+	 * flavor.
+	 */
 	smp_mb_master(RCU_MB_GROUP);
-	if (uatomic_read(&gp_futex) == -1)
-		futex_async(&gp_futex, FUTEX_WAIT, -1,
-		      NULL, NULL, 0);
+	for (;;) {
+		/* Temporarily unlock the registry lock. */
+		mutex_unlock(&rcu_registry_lock);
+		if (uatomic_read(&gp_futex) == -1) {
+			urcu_stats_sleep();
+			urcu_trace(RCU_TRACE_GP_SLEEP, 0);
+			futex_async(&gp_futex, FUTEX_WAIT, -1,
+			      urcu_stall_check_timeout(stall, &timeout),
+			      NULL, 0);
+			urcu_trace(RCU_TRACE_GP_WAKEUP, 0);
+		}
+		/* Re-lock the registry lock before the next loop. */
+		mutex_lock(&rcu_registry_lock);
+		/*
+		 * Keep sleeping if the wait timed out for a stall report:
+		 * no reader has exited its critical section since.
+		 */
+		if (uatomic_read(&gp_futex) != -1)
+			break;
+		if (urcu_stall_check_due(stall))
+			report_stalled_readers(stall);
+	}
 }
 
-void update_counter_and_wait(void)
+/*
+ * Stop awaiting readers which are not in a read-side critical section
+ * started before the counter update. Returns nonzero if some readers
+ * are still awaited.
+ */
+static int scan_readers(struct cds_list_head *qsreaders)
 {
-	CDS_LIST_HEAD(qsreaders);
-	int wait_loops = 0;
+	unsigned long nr_scanned = 0;
+#ifdef CONFIG_RCU_READER_SLAB
+	int ret;
+
+	ret = urcu_reader_slab_scan(reader_slabs, rcu_gp_ongoing, &nr_scanned);
+	urcu_stats_scanned(nr_scanned);
+	return ret;
+#else
 	struct rcu_reader *index, *tmp;
 
+	cds_list_for_each_entry_safe(index, tmp, &registry, node) {
+		nr_scanned++;
+		if (!rcu_gp_ongoing(&index->ctr))
+			cds_list_move(&index->node, qsreaders);
+	}
+	urcu_stats_scanned(nr_scanned);
+	return !cds_list_empty(&registry);
+#endif
+}
+
+/*
+ * Always called with rcu_registry lock held. Releases this lock between
+ * iterations and grabs it again. Holds the lock when it returns.
+ */
+void update_counter_and_wait(void)
+{
+	CDS_LIST_HEAD(qsreaders);
+	struct urcu_stall_check stall;
+	struct urcu_spin spin;
+	unsigned int attempts, wait_loops = 0;
+
+#ifdef RCU_GP_SINGLE_FLIP
+	/* Increment current G.P. */
+	CMM_STORE_SHARED(rcu_gp_ctr, rcu_gp_ctr + RCU_GP_CTR_PHASE);
+#else	/* #ifdef RCU_GP_SINGLE_FLIP */
 	/* Switch parity: 0 -> 1, 1 -> 0 */
 	CMM_STORE_SHARED(rcu_gp_ctr, rcu_gp_ctr ^ RCU_GP_CTR_PHASE);
+#endif	/* #else #ifdef RCU_GP_SINGLE_FLIP */
 
 	/*
 	 * Must commit rcu_gp_ctr update to memory before waiting for quiescent
@@ -240,35 +391,59 @@ void update_counter_and_wait(void)
 	 */
 	cmm_smp_mb();
 
+#ifdef CONFIG_RCU_READER_SLAB
+	urcu_reader_slab_start_scan(reader_slabs);
+#endif
+	urcu_stall_check_init(&stall, RCU_FLAVOR_NAME);
+	attempts = urcu_spin_begin(&spin);
+
 	/*
 	 * Wait for each thread URCU_TLS(rcu_reader).ctr count to become 0.
+	 * Once the busy-wait attempts are exhausted, each loop sleeps.
 	 */
 	for (;;) {
+#ifndef HAS_INCOHERENT_CACHES
+		if (wait_loops < attempts)
+			wait_loops++;
+#else
 		wait_loops++;
-		if (wait_loops == RCU_QS_ACTIVE_ATTEMPTS) {
+#endif
+		if (wait_loops == attempts && uatomic_read(&gp_expedited)) {
+			/*
+			 * Expedited grace period: instead of sleeping,
+			 * force readers to commit their counter and keep
+			 * busy-waiting.
+			 */
+			smp_mb_master(RCU_MB_GROUP);
+			urcu_spin_discard(&spin);
+			wait_loops = 0;
+		}
+		if (wait_loops == attempts) {
 			uatomic_dec(&gp_futex);
 			/* Write futex before read reader_gp */
 			smp_mb_master(RCU_MB_GROUP);
 		}
 
-		cds_list_for_each_entry_safe(index, tmp, &registry, node) {
-			if (!rcu_gp_ongoing(&index->ctr))
-				cds_list_move(&index->node, &qsreaders);
-		}
-
 #ifndef HAS_INCOHERENT_CACHES
-		if (cds_list_empty(&registry)) {
-			if (wait_loops == RCU_QS_ACTIVE_ATTEMPTS) {
+		if (!scan_readers(&qsreaders)) {
+			if (wait_loops == attempts) {
 				/* Read reader_gp before write futex */
 				smp_mb_master(RCU_MB_GROUP);
 				uatomic_set(&gp_futex, 0);
 			}
 			break;
 		} else {
-			if (wait_loops == RCU_QS_ACTIVE_ATTEMPTS)
-				wait_gp();
-			else
+			if (urcu_stall_check_due(&stall))
+				report_stalled_readers(&stall);
+			if (wait_loops == attempts) {
+				wait_gp(&stall);
+			} else {
+				/* Temporarily unlock the registry lock. */
+				mutex_unlock(&rcu_registry_lock);
 				caa_cpu_relax();
+				/* Re-lock the registry lock before the next loop. */
+				mutex_lock(&rcu_registry_lock);
+			}
 		}
 #else /* #ifndef HAS_INCOHERENT_CACHES */
 		/*
@@ -276,45 +451,98 @@ void update_counter_and_wait(void)
 		 * URCU_TLS(rcu_reader).ctr update to memory if we wait
 		 * for too long.
 		 */
-		if (cds_list_empty(&registry)) {
-			if (wait_loops == RCU_QS_ACTIVE_ATTEMPTS) {
+		if (!scan_readers(&qsreaders)) {
+			if (wait_loops == attempts) {
 				/* Read reader_gp before write futex */
 				smp_mb_master(RCU_MB_GROUP);
 				uatomic_set(&gp_futex, 0);
 			}
 			break;
 		} else {
-			switch (wait_loops) {
-			case RCU_QS_ACTIVE_ATTEMPTS:
-				wait_gp();
-				break; /* only escape switch */
-			case KICK_READER_LOOPS:
+			if (urcu_stall_check_due(&stall))
+				report_stalled_readers(&stall);
+			if (wait_loops == attempts) {
+				wait_gp(&stall);
+			} else if (wait_loops == KICK_READER_LOOPS) {
 				smp_mb_master(RCU_MB_GROUP);
+				urcu_spin_discard(&spin);
 				wait_loops = 0;
-				break; /* only escape switch */
-			default:
+			} else {
+				/* Temporarily unlock the registry lock. */
+				mutex_unlock(&rcu_registry_lock);
 				caa_cpu_relax();
+				/* Re-lock the registry lock before the next loop. */
+				mutex_lock(&rcu_registry_lock);
 			}
 		}
 #endif /* #else #ifndef HAS_INCOHERENT_CACHES */
 	}
+	urcu_spin_end(&spin, wait_loops);
+	urcu_trace(RCU_TRACE_GP_PHASE, wait_loops);
 	/* put back the reader list in the registry */
 	cds_list_splice(&qsreaders, &registry);
 }
 
-void synchronize_rcu(void)
+static void __synchronize_rcu(int expedited)
 {
+	DEFINE_URCU_WAIT_NODE(wait, URCU_WAIT_WAITING);
+	struct urcu_waiters waiters;
+
+	/*
+	 * Add ourself to gp_waiters queue of threads awaiting to wait
+	 * for a grace period. Proceed to perform the grace period only
+	 * if we are the first thread added into the queue.
+	 * The implicit memory barrier before urcu_wait_add()
+	 * orders prior memory accesses of threads put into the wait
+	 * queue before their insertion into the wait queue.
+	 */
+	if (urcu_wait_add(&gp_waiters, &wait) != 0) {
+		/* Not first in queue: will be awakened by another thread. */
+		if (expedited)
+			urcu_busy_wait(&wait);
+		else
+			urcu_adaptative_busy_wait(&wait);
+		/* Order following memory accesses after grace period. */
+		cmm_smp_mb();
+		return;
+	}
+	/* We won't need to wake ourself up */
+	urcu_wait_set_state(&wait, URCU_WAIT_RUNNING);
+
 	mutex_lock(&rcu_gp_lock);
 
+	/*
+	 * Move all waiters into our local queue. They have all been
+	 * queued before we start the grace period, so the grace period
+	 * performed below is also theirs.
+	 */
+	urcu_move_waiters(&waiters, &gp_waiters);
+
+	/*
+	 * Start grace period sequence for the polling API. Ordered before
+	 * the counter update by the following memory barrier.
+	 */
+	CMM_STORE_SHARED(rcu_gp_seq, rcu_gp_seq + 1);
+	urcu_trace(RCU_TRACE_GP_BEGIN, expedited);
+	urcu_stats_gp_begin();
+
+	mutex_lock(&rcu_registry_lock);
+
 	if (cds_list_empty(&registry))
 		goto out;
 
 	/* All threads should read qparity before accessing data structure
-	 * where new ptr points to. Must be done within rcu_gp_lock because it
-	 * iterates on reader threads.*/
+	 * where new ptr points to. Must be done within rcu_registry_lock
+	 * because it iterates on reader threads.*/
 	/* Write new ptr before changing the qparity */
 	smp_mb_master(RCU_MB_GROUP);
 
+#ifdef RCU_GP_SINGLE_FLIP
+	/*
+	 * Wait for readers which started before the counter increment.
+	 */
+	update_counter_and_wait();
+#else	/* #ifdef RCU_GP_SINGLE_FLIP */
 	/*
 	 * Wait for previous parity to be empty of readers.
 	 */
@@ -340,13 +568,45 @@ void synchronize_rcu(void)
 	 * Wait for previous parity to be empty of readers.
 	 */
 	update_counter_and_wait();	/* 1 -> 0, wait readers in parity 1 */
+#endif	/* #else #ifdef RCU_GP_SINGLE_FLIP */
 
 	/* Finish waiting for reader threads before letting the old ptr being
-	 * freed. Must be done within rcu_gp_lock because it iterates on reader
-	 * threads. */
+	 * freed. Must be done within rcu_registry_lock because it iterates on
+	 * reader threads. */
 	smp_mb_master(RCU_MB_GROUP);
 out:
+	mutex_unlock(&rcu_registry_lock);
+	/* End grace period sequence after reader accesses. */
+	cmm_smp_mb();
+	urcu_stats_gp_end(expedited);
+	CMM_STORE_SHARED(rcu_gp_seq, rcu_gp_seq + 1);
+	urcu_trace(RCU_TRACE_GP_END, expedited);
 	mutex_unlock(&rcu_gp_lock);
+
+	/*
+	 * Wakeup waiters only after we have completed the grace period
+	 * and have ensured the memory barriers at the end of the grace
+	 * period have been issued.
+	 */
+	urcu_wake_all_waiters(&waiters);
+}
+
+void synchronize_rcu(void)
+{
+	__synchronize_rcu(0);
+}
+
+void synchronize_rcu_expedited(void)
+{
+	uatomic_inc(&gp_expedited);
+	/*
+	 * Increment gp_expedited before reading gp_futex: a grace period
+	 * sleeping for readers is woken up, and busy-waits from now on.
+	 */
+	cmm_smp_mb();
+	wake_up_gp();
+	__synchronize_rcu(1);
+	uatomic_dec(&gp_expedited);
 }
 
 /*
@@ -367,29 +627,62 @@ void rcu_register_thread(void)
 {
 	URCU_TLS(rcu_reader).tid = pthread_self();
 	assert(URCU_TLS(rcu_reader).need_mb == 0);
-	assert(!(URCU_TLS(rcu_reader).ctr & RCU_GP_CTR_NEST_MASK));
+	assert(!_rcu_read_ongoing());
 
-	mutex_lock(&rcu_gp_lock);
+	mutex_lock(&rcu_registry_lock);
 	rcu_init();	/* In case gcc does not support constructor attribute */
+#ifdef CONFIG_RCU_READER_SLAB
+	URCU_TLS(rcu_reader).ctr = urcu_reader_slab_alloc(&reader_slabs);
+#endif
 	cds_list_add(&URCU_TLS(rcu_reader).node, &registry);
-	mutex_unlock(&rcu_gp_lock);
+	mutex_unlock(&rcu_registry_lock);
 }
 
 void rcu_unregister_thread(void)
 {
-	mutex_lock(&rcu_gp_lock);
+	mutex_lock(&rcu_registry_lock);
 	cds_list_del(&URCU_TLS(rcu_reader).node);
-	mutex_unlock(&rcu_gp_lock);
+#ifdef CONFIG_RCU_READER_SLAB
+	urcu_reader_slab_free(reader_slabs, URCU_TLS(rcu_reader).ctr);
+	URCU_TLS(rcu_reader).ctr = NULL;
+#endif
+	mutex_unlock(&rcu_registry_lock);
 }
 
 #ifdef RCU_MEMBARRIER
+/*
+ * Prefer the private expedited membarrier command, which only
+ * interrupts the CPUs running threads of this process, and must be
+ * registered before use. Fall back to the shared command, which waits
+ * for all CPUs to go through a scheduler context switch. Without
+ * either, readers issue full memory barriers themselves. Falling back
+ * to signals is left to the urcu-signal flavor, since this flavor
+ * cannot assume SIGRCU is unused by the application.
+ */
 void rcu_init(void)
 {
+	int mask;
+
 	if (init_done)
 		return;
 	init_done = 1;
-	if (!membarrier(MEMBARRIER_EXPEDITED | MEMBARRIER_QUERY))
-		has_sys_membarrier = 1;
+	mask = membarrier(URCU_MEMBARRIER_CMD_QUERY, 0);
+	if (mask < 0)
+		return;
+	if ((mask & URCU_MEMBARRIER_CMD_PRIVATE_EXPEDITED)
+	    && !membarrier(URCU_MEMBARRIER_CMD_REGISTER_PRIVATE_EXPEDITED, 0)) {
+		membarrier_cmd = URCU_MEMBARRIER_CMD_PRIVATE_EXPEDITED;
+	} else if (mask & URCU_MEMBARRIER_CMD_SHARED) {
+		membarrier_cmd = URCU_MEMBARRIER_CMD_SHARED;
+	} else {
+		return;
+	}
+	/*
+	 * Registration is complete before readers rely on
+	 * smp_mb_master() and drop their memory barriers.
+	 */
+	cmm_smp_mb();
+	CMM_STORE_SHARED(has_sys_membarrier, 1);
 }
 #endif
 
@@ -410,7 +703,7 @@ static void sigrcu_handler(int signo, siginfo_t *siginfo, void *context)
  * rcu_init constructor. Called when the library is linked, but also when
  * reader threads are calling rcu_register_thread().
  * Should only be called by a single thread at a given time. This is ensured by
- * holing the rcu_gp_lock from rcu_register_thread() or by running at library
+ * holing the rcu_registry_lock from rcu_register_thread() or by running at library
  * load time, which should not be executed by multiple threads nor concurrently
  * with rcu_register_thread() anyway.
  */
@@ -441,11 +734,20 @@ void rcu_exit(void)
 		urcu_die(errno);
 	assert(act.sa_sigaction == sigrcu_handler);
 	assert(cds_list_empty(&registry));
+	urcu_trace_exit();
 }
 
-#endif /* #ifdef RCU_SIGNAL */
+#else /* #ifdef RCU_SIGNAL */
+
+void rcu_exit(void)
+{
+	urcu_trace_exit();
+}
+
+#endif /* #else #ifdef RCU_SIGNAL */
 
 DEFINE_RCU_FLAVOR(rcu_flavor);
 
 #include "urcu-call-rcu-impl.h"
 #include "urcu-defer-impl.h"
+#include "urcu-poll-impl.h"
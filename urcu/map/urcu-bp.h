@@ -43,20 +43,35 @@
 #define rcu_init			rcu_init_bp
 #define rcu_exit			rcu_exit_bp
 #define synchronize_rcu			synchronize_rcu_bp
+#define synchronize_rcu_expedited	synchronize_rcu_expedited_bp
+#define rcu_set_stall_timeout		rcu_set_stall_timeout_bp
+#define rcu_trace_for_each_event	rcu_trace_for_each_event_bp
+#define rcu_trace_dump			rcu_trace_dump_bp
+#define rcu_get_stats			rcu_get_stats_bp
+#define rcu_set_wait_spin		rcu_set_wait_spin_bp
 #define rcu_reader			rcu_reader_bp
 #define rcu_gp_ctr			rcu_gp_ctr_bp
 
 #define get_cpu_call_rcu_data		get_cpu_call_rcu_data_bp
+#define get_node_call_rcu_data		get_node_call_rcu_data_bp
 #define get_call_rcu_thread		get_call_rcu_thread_bp
 #define create_call_rcu_data		create_call_rcu_data_bp
 #define set_cpu_call_rcu_data		set_cpu_call_rcu_data_bp
+#define set_node_call_rcu_data		set_node_call_rcu_data_bp
 #define get_default_call_rcu_data	get_default_call_rcu_data_bp
 #define get_call_rcu_data		get_call_rcu_data_bp
 #define get_thread_call_rcu_data	get_thread_call_rcu_data_bp
 #define set_thread_call_rcu_data	set_thread_call_rcu_data_bp
+#define set_call_rcu_data_batching	set_call_rcu_data_batching_bp
+#define set_call_rcu_data_backpressure	set_call_rcu_data_backpressure_bp
+#define get_call_rcu_data_backpressure_stats	get_call_rcu_data_backpressure_stats_bp
+#define get_call_rcu_data_qlen		get_call_rcu_data_qlen_bp
 #define create_all_cpu_call_rcu_data	create_all_cpu_call_rcu_data_bp
 #define free_all_cpu_call_rcu_data	free_all_cpu_call_rcu_data_bp
+#define create_all_node_call_rcu_data	create_all_node_call_rcu_data_bp
+#define free_all_node_call_rcu_data	free_all_node_call_rcu_data_bp
 #define call_rcu			call_rcu_bp
+#define rcu_barrier			rcu_barrier_bp
 
 #define defer_rcu			defer_rcu_bp
 #define rcu_defer_register_thread	rcu_defer_register_thread_bp
@@ -64,6 +79,10 @@
 #define rcu_defer_barrier		rcu_defer_barrier_bp
 #define rcu_defer_barrier_thread	rcu_defer_barrier_thread_bp
 
+#define start_poll_synchronize_rcu	start_poll_synchronize_rcu_bp
+#define poll_state_synchronize_rcu	poll_state_synchronize_rcu_bp
+#define cond_synchronize_rcu		cond_synchronize_rcu_bp
+
 #define rcu_flavor			rcu_flavor_bp
 
 #endif /* _URCU_BP_MAP_H */
@@ -46,19 +46,34 @@
 #define rcu_unregister_thread		rcu_unregister_thread_qsbr
 #define rcu_exit			rcu_exit_qsbr
 #define synchronize_rcu			synchronize_rcu_qsbr
+#define synchronize_rcu_expedited	synchronize_rcu_expedited_qsbr
+#define rcu_set_stall_timeout		rcu_set_stall_timeout_qsbr
+#define rcu_trace_for_each_event	rcu_trace_for_each_event_qsbr
+#define rcu_trace_dump			rcu_trace_dump_qsbr
+#define rcu_get_stats			rcu_get_stats_qsbr
+#define rcu_set_wait_spin		rcu_set_wait_spin_qsbr
 #define rcu_reader			rcu_reader_qsbr
 #define rcu_gp_ctr			rcu_gp_ctr_qsbr
 
 #define get_cpu_call_rcu_data		get_cpu_call_rcu_data_qsbr
+#define get_node_call_rcu_data		get_node_call_rcu_data_qsbr
 #define get_call_rcu_thread		get_call_rcu_thread_qsbr
 #define create_call_rcu_data		create_call_rcu_data_qsbr
 #define set_cpu_call_rcu_data		set_cpu_call_rcu_data_qsbr
+#define set_node_call_rcu_data		set_node_call_rcu_data_qsbr
 #define get_default_call_rcu_data	get_default_call_rcu_data_qsbr
 #define get_call_rcu_data		get_call_rcu_data_qsbr
 #define get_thread_call_rcu_data	get_thread_call_rcu_data_qsbr
 #define set_thread_call_rcu_data	set_thread_call_rcu_data_qsbr
+#define set_call_rcu_data_batching	set_call_rcu_data_batching_qsbr
+#define set_call_rcu_data_backpressure	set_call_rcu_data_backpressure_qsbr
+#define get_call_rcu_data_backpressure_stats	get_call_rcu_data_backpressure_stats_qsbr
+#define get_call_rcu_data_qlen		get_call_rcu_data_qlen_qsbr
 #define create_all_cpu_call_rcu_data	create_all_cpu_call_rcu_data_qsbr
+#define create_all_node_call_rcu_data	create_all_node_call_rcu_data_qsbr
+#define free_all_node_call_rcu_data	free_all_node_call_rcu_data_qsbr
 #define call_rcu			call_rcu_qsbr
+#define rcu_barrier			rcu_barrier_qsbr
 
 #define defer_rcu			defer_rcu_qsbr
 #define rcu_defer_register_thread	rcu_defer_register_thread_qsbr
@@ -66,6 +81,10 @@
 #define	rcu_defer_barrier		rcu_defer_barrier_qsbr
 #define rcu_defer_barrier_thread	rcu_defer_barrier_thread_qsbr
 
+#define start_poll_synchronize_rcu	start_poll_synchronize_rcu_qsbr
+#define poll_state_synchronize_rcu	poll_state_synchronize_rcu_qsbr
+#define cond_synchronize_rcu		cond_synchronize_rcu_qsbr
+
 #define rcu_flavor			rcu_flavor_qsbr
 
 #endif /* _URCU_QSBR_MAP_H */
@@ -53,9 +53,14 @@
 
 /* If the headers do not support SYS_membarrier, statically use RCU_MB */
 #ifdef SYS_membarrier
-# define MEMBARRIER_EXPEDITED		(1 << 0)
-# define MEMBARRIER_DELAYED		(1 << 1)
-# define MEMBARRIER_QUERY		(1 << 16)
+/*
+ * membarrier(2) commands, as in linux/membarrier.h, which may not be
+ * available even when SYS_membarrier is.
+ */
+# define URCU_MEMBARRIER_CMD_QUERY				0
+# define URCU_MEMBARRIER_CMD_SHARED				(1 << 0)
+# define URCU_MEMBARRIER_CMD_PRIVATE_EXPEDITED			(1 << 3)
+# define URCU_MEMBARRIER_CMD_REGISTER_PRIVATE_EXPEDITED	(1 << 4)
 # define membarrier(...)		syscall(SYS_membarrier, __VA_ARGS__)
 #else
 # undef RCU_MEMBARRIER
@@ -74,20 +79,35 @@
 #define rcu_init			rcu_init_memb
 #define rcu_exit			rcu_exit_memb
 #define synchronize_rcu			synchronize_rcu_memb
+#define synchronize_rcu_expedited	synchronize_rcu_expedited_memb
+#define rcu_set_stall_timeout		rcu_set_stall_timeout_memb
+#define rcu_trace_for_each_event	rcu_trace_for_each_event_memb
+#define rcu_trace_dump			rcu_trace_dump_memb
+#define rcu_get_stats			rcu_get_stats_memb
+#define rcu_set_wait_spin		rcu_set_wait_spin_memb
 #define rcu_reader			rcu_reader_memb
 #define rcu_gp_ctr			rcu_gp_ctr_memb
 
 #define get_cpu_call_rcu_data		get_cpu_call_rcu_data_memb
+#define get_node_call_rcu_data		get_node_call_rcu_data_memb
 #define get_call_rcu_thread		get_call_rcu_thread_memb
 #define create_call_rcu_data		create_call_rcu_data_memb
 #define set_cpu_call_rcu_data		set_cpu_call_rcu_data_memb
+#define set_node_call_rcu_data		set_node_call_rcu_data_memb
 #define get_default_call_rcu_data	get_default_call_rcu_data_memb
 #define get_call_rcu_data		get_call_rcu_data_memb
 #define get_thread_call_rcu_data	get_thread_call_rcu_data_memb
 #define set_thread_call_rcu_data	set_thread_call_rcu_data_memb
+#define set_call_rcu_data_batching	set_call_rcu_data_batching_memb
+#define set_call_rcu_data_backpressure	set_call_rcu_data_backpressure_memb
+#define get_call_rcu_data_backpressure_stats	get_call_rcu_data_backpressure_stats_memb
+#define get_call_rcu_data_qlen		get_call_rcu_data_qlen_memb
 #define create_all_cpu_call_rcu_data	create_all_cpu_call_rcu_data_memb
 #define free_all_cpu_call_rcu_data	free_all_cpu_call_rcu_data_memb
+#define create_all_node_call_rcu_data	create_all_node_call_rcu_data_memb
+#define free_all_node_call_rcu_data	free_all_node_call_rcu_data_memb
 #define call_rcu			call_rcu_memb
+#define rcu_barrier			rcu_barrier_memb
 
 #define defer_rcu			defer_rcu_memb
 #define rcu_defer_register_thread	rcu_defer_register_thread_memb
@@ -95,6 +115,10 @@
 #define rcu_defer_barrier		rcu_defer_barrier_memb
 #define rcu_defer_barrier_thread	rcu_defer_barrier_thread_memb
 
+#define start_poll_synchronize_rcu	start_poll_synchronize_rcu_memb
+#define poll_state_synchronize_rcu	poll_state_synchronize_rcu_memb
+#define cond_synchronize_rcu		cond_synchronize_rcu_memb
+
 #define rcu_flavor			rcu_flavor_memb
 
 #elif defined(RCU_SIGNAL)
@@ -108,20 +132,35 @@
 #define rcu_init			rcu_init_sig
 #define rcu_exit			rcu_exit_sig
 #define synchronize_rcu			synchronize_rcu_sig
+#define synchronize_rcu_expedited	synchronize_rcu_expedited_sig
+#define rcu_set_stall_timeout		rcu_set_stall_timeout_sig
+#define rcu_trace_for_each_event	rcu_trace_for_each_event_sig
+#define rcu_trace_dump			rcu_trace_dump_sig
+#define rcu_get_stats			rcu_get_stats_sig
+#define rcu_set_wait_spin		rcu_set_wait_spin_sig
 #define rcu_reader			rcu_reader_sig
 #define rcu_gp_ctr			rcu_gp_ctr_sig
 
 #define get_cpu_call_rcu_data		get_cpu_call_rcu_data_sig
+#define get_node_call_rcu_data		get_node_call_rcu_data_sig
 #define get_call_rcu_thread		get_call_rcu_thread_sig
 #define create_call_rcu_data		create_call_rcu_data_sig
 #define set_cpu_call_rcu_data		set_cpu_call_rcu_data_sig
+#define set_node_call_rcu_data		set_node_call_rcu_data_sig
 #define get_default_call_rcu_data	get_default_call_rcu_data_sig
 #define get_call_rcu_data		get_call_rcu_data_sig
 #define get_thread_call_rcu_data	get_thread_call_rcu_data_sig
 #define set_thread_call_rcu_data	set_thread_call_rcu_data_sig
+#define set_call_rcu_data_batching	set_call_rcu_data_batching_sig
+#define set_call_rcu_data_backpressure	set_call_rcu_data_backpressure_sig
+#define get_call_rcu_data_backpressure_stats	get_call_rcu_data_backpressure_stats_sig
+#define get_call_rcu_data_qlen		get_call_rcu_data_qlen_sig
 #define create_all_cpu_call_rcu_data	create_all_cpu_call_rcu_data_sig
 #define free_all_cpu_call_rcu_data	free_all_cpu_call_rcu_data_sig
+#define create_all_node_call_rcu_data	create_all_node_call_rcu_data_sig
+#define free_all_node_call_rcu_data	free_all_node_call_rcu_data_sig
 #define call_rcu			call_rcu_sig
+#define rcu_barrier			rcu_barrier_sig
 
 #define defer_rcu			defer_rcu_sig
 #define rcu_defer_register_thread	rcu_defer_register_thread_sig
@@ -129,6 +168,10 @@
 #define rcu_defer_barrier		rcu_defer_barrier_sig
 #define rcu_defer_barrier_thread	rcu_defer_barrier_thread_sig
 
+#define start_poll_synchronize_rcu	start_poll_synchronize_rcu_sig
+#define poll_state_synchronize_rcu	poll_state_synchronize_rcu_sig
+#define cond_synchronize_rcu		cond_synchronize_rcu_sig
+
 #define rcu_flavor			rcu_flavor_sig
 
 #elif defined(RCU_MB)
@@ -142,20 +185,35 @@
 #define rcu_init			rcu_init_mb
 #define rcu_exit			rcu_exit_mb
 #define synchronize_rcu			synchronize_rcu_mb
+#define synchronize_rcu_expedited	synchronize_rcu_expedited_mb
+#define rcu_set_stall_timeout		rcu_set_stall_timeout_mb
+#define rcu_trace_for_each_event	rcu_trace_for_each_event_mb
+#define rcu_trace_dump			rcu_trace_dump_mb
+#define rcu_get_stats			rcu_get_stats_mb
+#define rcu_set_wait_spin		rcu_set_wait_spin_mb
 #define rcu_reader			rcu_reader_mb
 #define rcu_gp_ctr			rcu_gp_ctr_mb
 
 #define get_cpu_call_rcu_data		get_cpu_call_rcu_data_mb
+#define get_node_call_rcu_data		get_node_call_rcu_data_mb
 #define get_call_rcu_thread		get_call_rcu_thread_mb
 #define create_call_rcu_data		create_call_rcu_data_mb
 #define set_cpu_call_rcu_data		set_cpu_call_rcu_data_mb
+#define set_node_call_rcu_data		set_node_call_rcu_data_mb
 #define get_default_call_rcu_data	get_default_call_rcu_data_mb
 #define get_call_rcu_data		get_call_rcu_data_mb
 #define get_thread_call_rcu_data	get_thread_call_rcu_data_mb
 #define set_thread_call_rcu_data	set_thread_call_rcu_data_mb
+#define set_call_rcu_data_batching	set_call_rcu_data_batching_mb
+#define set_call_rcu_data_backpressure	set_call_rcu_data_backpressure_mb
+#define get_call_rcu_data_backpressure_stats	get_call_rcu_data_backpressure_stats_mb
+#define get_call_rcu_data_qlen		get_call_rcu_data_qlen_mb
 #define create_all_cpu_call_rcu_data	create_all_cpu_call_rcu_data_mb
 #define free_all_cpu_call_rcu_data	free_all_cpu_call_rcu_data_mb
+#define create_all_node_call_rcu_data	create_all_node_call_rcu_data_mb
+#define free_all_node_call_rcu_data	free_all_node_call_rcu_data_mb
 #define call_rcu			call_rcu_mb
+#define rcu_barrier			rcu_barrier_mb
 
 #define defer_rcu			defer_rcu_mb
 #define rcu_defer_register_thread	rcu_defer_register_thread_mb
@@ -163,6 +221,10 @@
 #define rcu_defer_barrier		rcu_defer_barrier_mb
 #define rcu_defer_barrier_thread	rcu_defer_barrier_thread_mb
 
+#define start_poll_synchronize_rcu	start_poll_synchronize_rcu_mb
+#define poll_state_synchronize_rcu	poll_state_synchronize_rcu_mb
+#define cond_synchronize_rcu		cond_synchronize_rcu_mb
+
 #define rcu_flavor			rcu_flavor_mb
 
 #else
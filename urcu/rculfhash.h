@@ -100,6 +100,8 @@ void cds_lfht_node_init(struct cds_lfht_node *node)
 enum {
 	CDS_LFHT_AUTO_RESIZE = (1U << 0),
 	CDS_LFHT_ACCOUNTING = (1U << 1),
+	CDS_LFHT_BUCKET_TAGS = (1U << 2),
+	CDS_LFHT_INCREMENTAL_RESIZE = (1U << 3),
 };
 
 struct cds_lfht_mm_type {
@@ -138,7 +140,15 @@ struct cds_lfht *_cds_lfht_new(unsigned long init_size,
  *           CDS_LFHT_AUTO_RESIZE: automatically resize hash table.
  *           CDS_LFHT_ACCOUNTING: count the number of node addition
  *                                and removal in the table
+ *           CDS_LFHT_BUCKET_TAGS: keep a tag word per bucket summarizing
+ *                                 the hashes of its nodes, so lookups of
+ *                                 absent keys mostly skip the chain walk.
+ *           CDS_LFHT_INCREMENTAL_RESIZE: resize by slices of buckets,
+ *                                        with updaters helping to grow.
+ *                                        See cds_lfht_set_resize_slice.
  * @attr: optional resize worker thread attributes. NULL for default.
+ *        Worker threads are shared by the tables created with the same
+ *        attr.
  *
  * Return NULL on error.
  * Note: the RCU flavor must be already included before the hash table header.
@@ -211,6 +221,35 @@ void cds_lfht_lookup(struct cds_lfht *ht, unsigned long hash,
 		cds_lfht_match_fct match, const void *key,
 		struct cds_lfht_iter *iter);
 
+/*
+ * cds_lfht_lookup_key: hash and key of one lookup of a batch.
+ */
+struct cds_lfht_lookup_key {
+	unsigned long hash;
+	const void *key;
+};
+
+/*
+ * cds_lfht_lookup_batch - lookup nodes for a batch of keys.
+ * @ht: the hash table.
+ * @match: the key match function.
+ * @keys: array of nr_keys key hashes and keys.
+ * @nr_keys: number of keys to lookup.
+ * @iters: array of nr_keys iterators (output). iters[i] is set as
+ *         cds_lfht_lookup() would set it for keys[i].
+ *
+ * Same as calling cds_lfht_lookup() for each key, but the lookups of
+ * up to 16 keys progress together, one chain node at a time, each
+ * prefetching the next node it needs: the cache misses of different
+ * keys overlap instead of adding up.
+ * Call with rcu_read_lock held.
+ * Threads calling this API need to be registered RCU read-side threads.
+ * This function acts as a rcu_dereference() to read the node pointers.
+ */
+void cds_lfht_lookup_batch(struct cds_lfht *ht, cds_lfht_match_fct match,
+		const struct cds_lfht_lookup_key *keys, unsigned long nr_keys,
+		struct cds_lfht_iter *iters);
+
 /*
  * cds_lfht_next_duplicate - get the next item with same key, after iterator.
  * @ht: the hash table.
@@ -429,6 +468,70 @@ int cds_lfht_is_node_deleted(struct cds_lfht_node *node);
  */
 void cds_lfht_resize(struct cds_lfht *ht, unsigned long new_size);
 
+/*
+ * cds_lfht_bulk_load - add an array of nodes to an empty hash table.
+ * @ht: the hash table.
+ * @nodes: array of nr_nodes nodes to add. Reordered by hash.
+ * @hashes: array of the nr_nodes node hashes.
+ * @nr_nodes: number of nodes to add.
+ *
+ * Same as calling cds_lfht_add() for each node, but the table is first
+ * grown to the size fitting nr_nodes nodes, and the nodes, sorted by
+ * hash, are linked in a single pass over the buckets, each bucket
+ * chain being published at once. Node arrays already sorted, such as
+ * the nodes of a table in cds_lfht_for_each() order, are not sorted
+ * again. Large tables are linked by the resize worker threads.
+ *
+ * Return 0 on success, -EPERM if the hash table contains any node, in
+ * which case no node is added.
+ * The hash table must not be updated nor resized concurrently: the
+ * behavior is undefined if a node is added concurrently, as it may be
+ * unlinked and leaked. Lookups and traversals may run concurrently,
+ * and see each bucket either empty or with all its nodes.
+ * Threads calling this API need to be registered RCU read-side threads,
+ * and must not hold the RCU read-side lock.
+ * This function does not (necessarily) issue memory barriers.
+ */
+int cds_lfht_bulk_load(struct cds_lfht *ht, struct cds_lfht_node **nodes,
+		const unsigned long *hashes, unsigned long nr_nodes);
+
+/*
+ * cds_lfht_set_resize_workers - set the number of resize worker threads.
+ * @nr_workers: number of worker threads helping with the resize of
+ *              large tables, in addition to the thread resizing.
+ *
+ * Resize worker threads are long-lived, and shared by the hash tables
+ * created with the same resize thread attributes. They are created when
+ * first needed, and joined when the last of these hash tables is
+ * destroyed. By default, there is one worker thread per CPU, besides
+ * the thread resizing. Worker threads in excess exit once idle; 0
+ * leaves resizes to the thread resizing alone.
+ */
+void cds_lfht_set_resize_workers(unsigned long nr_workers);
+
+/*
+ * cds_lfht_set_resize_slice - set the resize slices of a hash table.
+ * @ht: the hash table, created with CDS_LFHT_INCREMENTAL_RESIZE.
+ * @nr_buckets: number of buckets initialized or removed by the thread
+ *              resizing at once (4096 by default).
+ * @pause_us: pause of the thread resizing after each slice, in
+ *            microseconds. 0 (the default) yields the CPU.
+ *
+ * With CDS_LFHT_INCREMENTAL_RESIZE, the thread resizing the table (the
+ * call_rcu worker thread for automatic resize, or the thread calling
+ * cds_lfht_resize) does not use the resize worker threads: it
+ * initializes or removes the buckets of each order by slices, and
+ * pauses after each slice, in a quiescent state. Meanwhile, each
+ * cds_lfht_add, cds_lfht_add_unique, cds_lfht_add_replace and
+ * cds_lfht_del of a growing table initializes a few of its new buckets,
+ * so growing keeps up with the updaters.
+ *
+ * Returns 0 on success, -EINVAL if nr_buckets is 0 or if the table is
+ * not incrementally resized.
+ */
+int cds_lfht_set_resize_slice(struct cds_lfht *ht, unsigned long nr_buckets,
+		unsigned long pause_us);
+
 /*
  * Note: it is safe to perform element removal (del), replacement, or
  * any hash table update operation during any of the following hash
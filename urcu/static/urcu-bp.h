@@ -119,6 +119,14 @@ static inline void debug_yield_init(void)
 #define RCU_GP_CTR_PHASE		(1UL << (sizeof(long) << 2))
 #define RCU_GP_CTR_NEST_MASK	(RCU_GP_CTR_PHASE - 1)
 
+/*
+ * In single-flip mode, the bits above RCU_GP_CTR_NEST_MASK hold a grace
+ * period counter rather than a single parity bit. See urcu/static/urcu.h.
+ */
+#if defined(CONFIG_RCU_GP_SINGLE_FLIP) && (CAA_BITS_PER_LONG >= 64)
+#define RCU_GP_SINGLE_FLIP
+#endif
+
 /*
  * Used internally by _rcu_read_lock.
  */
@@ -159,7 +167,7 @@ static inline int rcu_old_gp_ongoing(long *value)
 	 */
 	v = CMM_LOAD_SHARED(*value);
 	return (v & RCU_GP_CTR_NEST_MASK) &&
-		 ((v ^ rcu_gp_ctr) & RCU_GP_CTR_PHASE);
+		 ((v ^ rcu_gp_ctr) & ~RCU_GP_CTR_NEST_MASK);
 }
 
 static inline void _rcu_read_lock(void)
@@ -198,6 +206,16 @@ static inline void _rcu_read_unlock(void)
 	cmm_barrier();	/* Ensure the compiler does not reorder us with mutex */
 }
 
+/*
+ * Returns whether within a RCU read-side critical section.
+ */
+static inline int _rcu_read_ongoing(void)
+{
+	if (caa_unlikely(!URCU_TLS(rcu_reader)))
+		return 0;
+	return URCU_TLS(rcu_reader)->ctr & RCU_GP_CTR_NEST_MASK;
+}
+
 #ifdef __cplusplus 
 }
 #endif
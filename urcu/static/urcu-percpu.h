@@ -0,0 +1,365 @@
+#ifndef _URCU_PERCPU_STATIC_H
+#define _URCU_PERCPU_STATIC_H
+
+/*
+ * urcu-percpu-static.h
+ *
+ * Userspace RCU header, per-CPU reader counters version.
+ *
+ * TO BE INCLUDED ONLY IN LGPL-COMPATIBLE CODE. See urcu-percpu.h for
+ * linking dynamically with the userspace rcu library.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include <stdlib.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <stdint.h>
+
+#include <urcu/compiler.h>
+#include <urcu/arch.h>
+#include <urcu/system.h>
+#include <urcu/uatomic.h>
+#include <urcu/futex.h>
+#include <urcu/tls-compat.h>
+#include <urcu/config.h>
+
+/*
+ * The read-side increments the counters of the CPU it runs on within a
+ * restartable sequence. Only implemented for x86_64, with the rseq area
+ * registered by the C library. Elsewhere, counters are incremented
+ * atomically.
+ */
+#if defined(CONFIG_RCU_HAVE_RSEQ) && defined(__x86_64__)
+#define URCU_PERCPU_RSEQ
+#include <stddef.h>
+#include <sys/rseq.h>
+#endif
+
+/*
+ * This code section can only be included in LGPL 2.1 compatible source code.
+ * See below for the function call wrappers which can be used in code meant to
+ * be only linked with the Userspace RCU library. This comes with a small
+ * performance degradation on the read-side due to the added function calls.
+ * This is required to permit relinking with newer versions of the library.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifdef __linux__
+#include <syscall.h>
+#endif
+
+#ifdef SYS_membarrier
+/*
+ * membarrier(2) commands, as in linux/membarrier.h, which may not be
+ * available even when SYS_membarrier is.
+ */
+# define URCU_MEMBARRIER_CMD_QUERY				0
+# define URCU_MEMBARRIER_CMD_SHARED				(1 << 0)
+# define URCU_MEMBARRIER_CMD_PRIVATE_EXPEDITED			(1 << 3)
+# define URCU_MEMBARRIER_CMD_REGISTER_PRIVATE_EXPEDITED	(1 << 4)
+# define membarrier(...)		syscall(SYS_membarrier, __VA_ARGS__)
+#endif
+
+#ifdef DEBUG_RCU
+#define rcu_assert(args...)	assert(args)
+#else
+#define rcu_assert(args...)
+#endif
+
+#ifdef DEBUG_YIELD
+#include <sched.h>
+#include <time.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#define YIELD_READ 	(1 << 0)
+#define YIELD_WRITE	(1 << 1)
+
+/*
+ * Updates without RCU_MB are much slower. Account this in
+ * the delay.
+ */
+/* maximum sleep delay, in us */
+#define MAX_SLEEP 50
+
+extern unsigned int yield_active;
+extern DECLARE_URCU_TLS(unsigned int, rand_yield);
+
+static inline void debug_yield_read(void)
+{
+	if (yield_active & YIELD_READ)
+		if (rand_r(&URCU_TLS(rand_yield)) & 0x1)
+			usleep(rand_r(&URCU_TLS(rand_yield)) % MAX_SLEEP);
+}
+
+static inline void debug_yield_write(void)
+{
+	if (yield_active & YIELD_WRITE)
+		if (rand_r(&URCU_TLS(rand_yield)) & 0x1)
+			usleep(rand_r(&URCU_TLS(rand_yield)) % MAX_SLEEP);
+}
+
+static inline void debug_yield_init(void)
+{
+	URCU_TLS(rand_yield) = time(NULL) ^ pthread_self();
+}
+#else
+static inline void debug_yield_read(void)
+{
+}
+
+static inline void debug_yield_write(void)
+{
+}
+
+static inline void debug_yield_init(void)
+{
+
+}
+#endif
+
+/*
+ * Readers only issue compiler barriers when synchronize_rcu() can rely
+ * on membarrier(2) to order their accesses.
+ */
+extern int has_sys_membarrier;
+
+static inline void smp_mb_slave(void)
+{
+	if (caa_likely(has_sys_membarrier))
+		cmm_barrier();
+	else
+		cmm_smp_mb();
+}
+
+/*
+ * Counts of read-side critical sections entered and exited on a CPU,
+ * for each of the two grace period phases. A grace period awaits a
+ * phase until, summed over all CPUs, its unlock count catches up with
+ * its lock count. A reader may exit its critical section on another
+ * CPU than the one it entered it on: only the sums are meaningful.
+ */
+struct rcu_percpu_count {
+	unsigned long lock;
+	unsigned long unlock;
+};
+
+struct rcu_percpu_ctr {
+	/* Only incremented by restartable sequences on this CPU. */
+	struct rcu_percpu_count rseq[2];
+	/* Incremented atomically, from any CPU. */
+	struct rcu_percpu_count atomic[2];
+} __attribute__((aligned(CAA_CACHE_LINE_SIZE)));
+
+/*
+ * Per-CPU counters, allocated once by the library, with
+ * rcu_percpu_nr_cpus entries.
+ */
+extern struct rcu_percpu_ctr *rcu_percpu_ctrs;
+extern int rcu_percpu_nr_cpus;
+
+/*
+ * Global grace period counter. Its low-order bit selects the phase
+ * counted by new readers. Written to only by writer with mutex taken.
+ */
+extern unsigned long rcu_gp_ctr;
+
+struct rcu_reader {
+	unsigned long nesting;
+	/* Phase counted by the outermost read-side critical section. */
+	unsigned long phase;
+	/*
+	 * 1 + index of the counters incremented atomically by this
+	 * thread when rseq is unavailable. 0 until the thread first
+	 * enters a read-side critical section.
+	 */
+	int slot;
+};
+
+extern DECLARE_URCU_TLS(struct rcu_reader, rcu_reader);
+
+/*
+ * Used internally by _rcu_read_lock. Assigns the thread its fallback
+ * counter slot, allocating the per-CPU counters on first use.
+ */
+extern void rcu_percpu_register(void);
+
+extern int32_t gp_futex;
+
+/*
+ * Wake-up waiting synchronize_rcu(). Called from many concurrent threads.
+ */
+static inline void wake_up_gp(void)
+{
+	if (caa_unlikely(uatomic_read(&gp_futex) == -1)) {
+		uatomic_set(&gp_futex, 0);
+		futex_async(&gp_futex, FUTEX_WAKE, 1,
+		      NULL, NULL, 0);
+	}
+}
+
+#ifdef URCU_PERCPU_RSEQ
+/*
+ * Add 1 to *v, unless the thread migrates away from "cpu" or is
+ * preempted or signaled before the addition. Returns 0 on success, -1
+ * if the restartable sequence was aborted.
+ */
+static inline int rcu_percpu_rseq_inc(unsigned long *v, int cpu)
+{
+	__asm__ __volatile__ goto (
+		".pushsection __rseq_cs, \"aw\"\n\t"
+		".balign 32\n\t"
+		"3:\n\t"
+		".long 0x0, 0x0\n\t"
+		".quad 1f, (2f - 1f), 4f\n\t"
+		".popsection\n\t"
+		"leaq 3b(%%rip), %%rax\n\t"
+		"movq %%rax, %%fs:8(%[rseq_offset])\n\t"
+		"1:\n\t"
+		"cmpl %[cpu], %%fs:4(%[rseq_offset])\n\t"
+		"jnz %l[abort]\n\t"
+		"addq $1, %[v]\n\t"
+		"2:\n\t"
+		".pushsection __rseq_failure, \"ax\"\n\t"
+		/* Signature, as registered by the C library. */
+		".byte 0x0f, 0xb9, 0x3d\n\t"
+		".long 0x53053053\n\t"
+		"4:\n\t"
+		"jmp %l[abort]\n\t"
+		".popsection\n\t"
+		: /* gcc asm goto does not allow outputs */
+		: [cpu] "r" (cpu),
+		  [rseq_offset] "r" (__rseq_offset),
+		  [v] "m" (*v)
+		: "memory", "cc", "rax"
+		: abort
+	);
+	return 0;
+abort:
+	return -1;
+}
+
+/*
+ * CPU the thread runs on, as maintained by the kernel in the rseq
+ * area. Negative if rseq is not registered for this thread.
+ */
+static inline int rcu_percpu_cpu(void)
+{
+	int cpu;
+
+	__asm__ __volatile__ ("movl %%fs:4(%[rseq_offset]), %[cpu]"
+		: [cpu] "=r" (cpu)
+		: [rseq_offset] "r" (__rseq_offset));
+	return cpu;
+}
+#endif /* URCU_PERCPU_RSEQ */
+
+/*
+ * Count a reader entering (lock) or exiting (unlock) phase "phase".
+ * Uses the counters of the current CPU without atomic instruction when
+ * possible, else the counters of the thread's fallback slot.
+ */
+static inline void rcu_percpu_inc(unsigned long phase, int unlock)
+{
+	struct rcu_percpu_ctr *ctrs = rcu_percpu_ctrs;
+	struct rcu_percpu_count *count;
+
+#ifdef URCU_PERCPU_RSEQ
+	int cpu = rcu_percpu_cpu();
+
+	if (caa_likely(cpu >= 0 && cpu < rcu_percpu_nr_cpus)) {
+		count = &ctrs[cpu].rseq[phase];
+		if (caa_likely(!rcu_percpu_rseq_inc(unlock ? &count->unlock
+				: &count->lock, cpu)))
+			return;
+	}
+#endif
+	count = &ctrs[URCU_TLS(rcu_reader).slot - 1].atomic[phase];
+	uatomic_inc(unlock ? &count->unlock : &count->lock);
+}
+
+/*
+ * A signal handler may run a read-side critical section at any point
+ * of the outermost lock and unlock of the thread it interrupts. Until
+ * nesting is published, and once it is back to 0, such a section is
+ * itself outermost and overwrites .phase: the interrupted lock only
+ * stores .phase after publishing nesting, and the interrupted unlock
+ * reads .phase before decrementing nesting.
+ */
+static inline void _rcu_read_lock(void)
+{
+	unsigned long phase;
+
+	/* Check if the thread got its counters */
+	if (caa_unlikely(!URCU_TLS(rcu_reader).slot))
+		rcu_percpu_register();
+
+	cmm_barrier();	/* Ensure the compiler does not reorder us with mutex */
+	if (caa_likely(!URCU_TLS(rcu_reader).nesting)) {
+		phase = CMM_LOAD_SHARED(rcu_gp_ctr) & 1;
+		rcu_percpu_inc(phase, 0);
+		/*
+		 * Count the reader before accessing the pointer. Pairs
+		 * with the barrier between the unlock and lock sums of
+		 * synchronize_rcu().
+		 */
+		smp_mb_slave();
+		URCU_TLS(rcu_reader).nesting = 1;
+		cmm_barrier();	/* Publish nesting before phase */
+		URCU_TLS(rcu_reader).phase = phase;
+	} else {
+		URCU_TLS(rcu_reader).nesting++;
+	}
+	cmm_barrier();
+}
+
+static inline void _rcu_read_unlock(void)
+{
+	unsigned long phase;
+
+	cmm_barrier();
+	phase = URCU_TLS(rcu_reader).phase;
+	cmm_barrier();	/* Read phase before nesting */
+	if (caa_likely(!--URCU_TLS(rcu_reader).nesting)) {
+		/*
+		 * Finish using rcu before counting the reader out.
+		 */
+		smp_mb_slave();
+		rcu_percpu_inc(phase, 1);
+		/* write the counter before read futex */
+		smp_mb_slave();
+		wake_up_gp();
+	}
+	cmm_barrier();	/* Ensure the compiler does not reorder us with mutex */
+}
+
+/*
+ * Returns whether within a RCU read-side critical section.
+ */
+static inline int _rcu_read_ongoing(void)
+{
+	return URCU_TLS(rcu_reader).nesting;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _URCU_PERCPU_STATIC_H */
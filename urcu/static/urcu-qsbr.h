@@ -122,15 +122,46 @@ extern unsigned long rcu_gp_ctr;
 
 struct rcu_reader {
 	/* Data used by both reader and synchronize_rcu() */
+#ifdef CONFIG_RCU_READER_SLAB
+	unsigned long *ctr;	/* Slot in a registry slab, NULL if unregistered */
+	unsigned long unregistered_ctr;
+#else
 	unsigned long ctr;
+#endif
 	/* Data used for registry */
 	struct cds_list_head node __attribute__((aligned(CAA_CACHE_LINE_SIZE)));
 	int waiting;
 	pthread_t tid;
+	/*
+	 * Grace periods which had to sleep waiting for this reader, and
+	 * how long they waited. Used by synchronize_rcu() only.
+	 */
+	int stalled;
+	unsigned long stalls;
+	uint64_t stall_ns, stall_max_ns, stall_total_ns;
 };
 
 extern DECLARE_URCU_TLS(struct rcu_reader, rcu_reader);
 
+/*
+ * Counter of the current reader thread. With CONFIG_RCU_READER_SLAB, it
+ * is allocated in a cache-line aligned registry slab when the thread
+ * registers, so synchronize_rcu() scans reader counters sequentially.
+ * Threads which are not registered, but still use the read-side
+ * primitives (as done internally by call_rcu()), get a counter in
+ * their TLS, which is never awaited.
+ */
+static inline unsigned long *rcu_reader_ctr(void)
+{
+#ifdef CONFIG_RCU_READER_SLAB
+	if (caa_unlikely(!URCU_TLS(rcu_reader).ctr))
+		return &URCU_TLS(rcu_reader).unregistered_ctr;
+	return URCU_TLS(rcu_reader).ctr;
+#else
+	return &URCU_TLS(rcu_reader).ctr;
+#endif
+}
+
 extern int32_t gp_futex;
 
 /*
@@ -159,7 +190,7 @@ static inline int rcu_gp_ongoing(unsigned long *ctr)
 
 static inline void _rcu_read_lock(void)
 {
-	rcu_assert(URCU_TLS(rcu_reader).ctr);
+	rcu_assert(*rcu_reader_ctr());
 }
 
 static inline void _rcu_read_unlock(void)
@@ -169,7 +200,7 @@ static inline void _rcu_read_unlock(void)
 static inline void _rcu_quiescent_state(void)
 {
 	cmm_smp_mb();
-	_CMM_STORE_SHARED(URCU_TLS(rcu_reader).ctr, _CMM_LOAD_SHARED(rcu_gp_ctr));
+	_CMM_STORE_SHARED(*rcu_reader_ctr(), _CMM_LOAD_SHARED(rcu_gp_ctr));
 	cmm_smp_mb();	/* write URCU_TLS(rcu_reader).ctr before read futex */
 	wake_up_gp();
 	cmm_smp_mb();
@@ -178,7 +209,7 @@ static inline void _rcu_quiescent_state(void)
 static inline void _rcu_thread_offline(void)
 {
 	cmm_smp_mb();
-	CMM_STORE_SHARED(URCU_TLS(rcu_reader).ctr, 0);
+	CMM_STORE_SHARED(*rcu_reader_ctr(), 0);
 	cmm_smp_mb();	/* write URCU_TLS(rcu_reader).ctr before read futex */
 	wake_up_gp();
 	cmm_barrier();	/* Ensure the compiler does not reorder us with mutex */
@@ -187,10 +218,19 @@ static inline void _rcu_thread_offline(void)
 static inline void _rcu_thread_online(void)
 {
 	cmm_barrier();	/* Ensure the compiler does not reorder us with mutex */
-	_CMM_STORE_SHARED(URCU_TLS(rcu_reader).ctr, CMM_LOAD_SHARED(rcu_gp_ctr));
+	_CMM_STORE_SHARED(*rcu_reader_ctr(), CMM_LOAD_SHARED(rcu_gp_ctr));
 	cmm_smp_mb();
 }
 
+/*
+ * Returns whether the thread is online, thus whether it is allowed
+ * to be within RCU read-side critical sections.
+ */
+static inline int _rcu_read_ongoing(void)
+{
+	return !!*rcu_reader_ctr();
+}
+
 #ifdef __cplusplus 
 }
 #endif
@@ -65,9 +65,14 @@ extern "C" {
 
 /* If the headers do not support SYS_membarrier, statically use RCU_MB */
 #ifdef SYS_membarrier
-# define MEMBARRIER_EXPEDITED		(1 << 0)
-# define MEMBARRIER_DELAYED		(1 << 1)
-# define MEMBARRIER_QUERY		(1 << 16)
+/*
+ * membarrier(2) commands, as in linux/membarrier.h, which may not be
+ * available even when SYS_membarrier is.
+ */
+# define URCU_MEMBARRIER_CMD_QUERY				0
+# define URCU_MEMBARRIER_CMD_SHARED				(1 << 0)
+# define URCU_MEMBARRIER_CMD_PRIVATE_EXPEDITED			(1 << 3)
+# define URCU_MEMBARRIER_CMD_REGISTER_PRIVATE_EXPEDITED	(1 << 4)
 # define membarrier(...)		syscall(SYS_membarrier, __VA_ARGS__)
 #else
 # undef RCU_MEMBARRIER
@@ -207,6 +212,19 @@ static inline void smp_mb_slave(int group)
 #define RCU_GP_CTR_PHASE	(1UL << (sizeof(unsigned long) << 2))
 #define RCU_GP_CTR_NEST_MASK	(RCU_GP_CTR_PHASE - 1)
 
+/*
+ * In single-flip mode, the bits above RCU_GP_CTR_NEST_MASK hold a grace
+ * period counter incremented once per grace period rather than a single
+ * parity bit. A reader snapshot can then only alias the current counter
+ * if the reader stays preempted between its load of rcu_gp_ctr and its
+ * store to its own counter for 2^32 grace periods, so one counter
+ * update and one registry scan are enough per grace period. Only
+ * available when long is at least 64-bit wide.
+ */
+#if defined(CONFIG_RCU_GP_SINGLE_FLIP) && (CAA_BITS_PER_LONG >= 64)
+#define RCU_GP_SINGLE_FLIP
+#endif
+
 /*
  * Global quiescent period counter with low-order bits unused.
  * Using a int rather than a char to eliminate false register dependencies
@@ -216,7 +234,12 @@ extern unsigned long rcu_gp_ctr;
 
 struct rcu_reader {
 	/* Data used by both reader and synchronize_rcu() */
+#ifdef CONFIG_RCU_READER_SLAB
+	unsigned long *ctr;	/* Slot in a registry slab, NULL if unregistered */
+	unsigned long unregistered_ctr;
+#else
 	unsigned long ctr;
+#endif
 	char need_mb;
 	/* Data used for registry */
 	struct cds_list_head node __attribute__((aligned(CAA_CACHE_LINE_SIZE)));
@@ -225,6 +248,25 @@ struct rcu_reader {
 
 extern DECLARE_URCU_TLS(struct rcu_reader, rcu_reader);
 
+/*
+ * Counter of the current reader thread. With CONFIG_RCU_READER_SLAB, it
+ * is allocated in a cache-line aligned registry slab when the thread
+ * registers, so synchronize_rcu() scans reader counters sequentially.
+ * Threads which are not registered, but still use the read-side
+ * primitives (as done internally by call_rcu()), get a counter in
+ * their TLS, which is never awaited.
+ */
+static inline unsigned long *rcu_reader_ctr(void)
+{
+#ifdef CONFIG_RCU_READER_SLAB
+	if (caa_unlikely(!URCU_TLS(rcu_reader).ctr))
+		return &URCU_TLS(rcu_reader).unregistered_ctr;
+	return URCU_TLS(rcu_reader).ctr;
+#else
+	return &URCU_TLS(rcu_reader).ctr;
+#endif
+}
+
 extern int32_t gp_futex;
 
 /*
@@ -249,7 +291,7 @@ static inline int rcu_gp_ongoing(unsigned long *ctr)
 	 */
 	v = CMM_LOAD_SHARED(*ctr);
 	return (v & RCU_GP_CTR_NEST_MASK) &&
-		 ((v ^ rcu_gp_ctr) & RCU_GP_CTR_PHASE);
+		 ((v ^ rcu_gp_ctr) & ~RCU_GP_CTR_NEST_MASK);
 }
 
 static inline void _rcu_read_lock(void)
@@ -257,20 +299,20 @@ static inline void _rcu_read_lock(void)
 	unsigned long tmp;
 
 	cmm_barrier();	/* Ensure the compiler does not reorder us with mutex */
-	tmp = URCU_TLS(rcu_reader).ctr;
+	tmp = *rcu_reader_ctr();
 	/*
 	 * rcu_gp_ctr is
 	 *   RCU_GP_COUNT | (~RCU_GP_CTR_PHASE or RCU_GP_CTR_PHASE)
 	 */
 	if (caa_likely(!(tmp & RCU_GP_CTR_NEST_MASK))) {
-		_CMM_STORE_SHARED(URCU_TLS(rcu_reader).ctr, _CMM_LOAD_SHARED(rcu_gp_ctr));
+		_CMM_STORE_SHARED(*rcu_reader_ctr(), _CMM_LOAD_SHARED(rcu_gp_ctr));
 		/*
 		 * Set active readers count for outermost nesting level before
 		 * accessing the pointer. See smp_mb_master().
 		 */
 		smp_mb_slave(RCU_MB_GROUP);
 	} else {
-		_CMM_STORE_SHARED(URCU_TLS(rcu_reader).ctr, tmp + RCU_GP_COUNT);
+		_CMM_STORE_SHARED(*rcu_reader_ctr(), tmp + RCU_GP_COUNT);
 	}
 }
 
@@ -278,23 +320,31 @@ static inline void _rcu_read_unlock(void)
 {
 	unsigned long tmp;
 
-	tmp = URCU_TLS(rcu_reader).ctr;
+	tmp = *rcu_reader_ctr();
 	/*
 	 * Finish using rcu before decrementing the pointer.
 	 * See smp_mb_master().
 	 */
 	if (caa_likely((tmp & RCU_GP_CTR_NEST_MASK) == RCU_GP_COUNT)) {
 		smp_mb_slave(RCU_MB_GROUP);
-		_CMM_STORE_SHARED(URCU_TLS(rcu_reader).ctr, URCU_TLS(rcu_reader).ctr - RCU_GP_COUNT);
+		_CMM_STORE_SHARED(*rcu_reader_ctr(), *rcu_reader_ctr() - RCU_GP_COUNT);
 		/* write URCU_TLS(rcu_reader).ctr before read futex */
 		smp_mb_slave(RCU_MB_GROUP);
 		wake_up_gp();
 	} else {
-		_CMM_STORE_SHARED(URCU_TLS(rcu_reader).ctr, URCU_TLS(rcu_reader).ctr - RCU_GP_COUNT);
+		_CMM_STORE_SHARED(*rcu_reader_ctr(), *rcu_reader_ctr() - RCU_GP_COUNT);
 	}
 	cmm_barrier();	/* Ensure the compiler does not reorder us with mutex */
 }
 
+/*
+ * Returns whether within a RCU read-side critical section.
+ */
+static inline int _rcu_read_ongoing(void)
+{
+	return *rcu_reader_ctr() & RCU_GP_CTR_NEST_MASK;
+}
+
 #ifdef __cplusplus
 }
 #endif
@@ -29,6 +29,7 @@
 #include <pthread.h>
 #include <assert.h>
 #include <poll.h>
+#include <sched.h>
 #include <urcu/compiler.h>
 #include <urcu/uatomic.h>
 
@@ -45,8 +46,14 @@ extern "C" {
  * Paul E. McKenney.
  */
 
+/*
+ * Waiting for a concurrent enqueuer to set the next pointer busy-loops
+ * first, then yields the CPU, which lets a preempted enqueuer complete
+ * without waiting for a whole sleep, and only then sleeps.
+ */
 #define WFQ_ADAPT_ATTEMPTS		10	/* Retry if being set */
-#define WFQ_WAIT			10	/* Wait 10 ms if being set */
+#define WFQ_YIELD_ATTEMPTS		10	/* Then yield if being set */
+#define WFQ_WAIT			10	/* Then wait 10 ms if being set */
 
 static inline void _cds_wfq_node_init(struct cds_wfq_node *node)
 {
@@ -97,10 +104,12 @@ ___cds_wfq_node_sync_next(struct cds_wfq_node *node)
 	 * Adaptative busy-looping waiting for enqueuer to complete enqueue.
 	 */
 	while ((next = CMM_LOAD_SHARED(node->next)) == NULL) {
-		if (++attempt >= WFQ_ADAPT_ATTEMPTS) {
+		if (++attempt >= WFQ_ADAPT_ATTEMPTS + WFQ_YIELD_ATTEMPTS) {
 			poll(NULL, 0, WFQ_WAIT);	/* Wait for 10ms */
 			attempt = 0;
-		} else
+		} else if (attempt >= WFQ_ADAPT_ATTEMPTS)
+			sched_yield();
+		else
 			caa_cpu_relax();
 	}
 
@@ -29,6 +29,7 @@
 #include <pthread.h>
 #include <assert.h>
 #include <poll.h>
+#include <sched.h>
 #include <urcu/compiler.h>
 #include <urcu/uatomic.h>
 
@@ -37,8 +38,14 @@ extern "C" {
 #endif
 
 #define CDS_WF_STACK_END			((void *)0x1UL)
+/*
+ * Waiting for a concurrent push to set the next pointer busy-loops
+ * first, then yields the CPU, which lets a preempted pusher complete
+ * without waiting for a whole sleep, and only then sleeps.
+ */
 #define CDS_WFS_ADAPT_ATTEMPTS		10	/* Retry if being set */
-#define CDS_WFS_WAIT			10	/* Wait 10 ms if being set */
+#define CDS_WFS_YIELD_ATTEMPTS		10	/* Then yield if being set */
+#define CDS_WFS_WAIT			10	/* Then wait 10 ms if being set */
 
 static inline
 void _cds_wfs_node_init(struct cds_wfs_node *node)
@@ -96,10 +103,12 @@ retry:
 	 * Adaptative busy-looping waiting for push to complete.
 	 */
 	while ((next = CMM_LOAD_SHARED(head->next)) == NULL) {
-		if (++attempt >= CDS_WFS_ADAPT_ATTEMPTS) {
+		if (++attempt >= CDS_WFS_ADAPT_ATTEMPTS + CDS_WFS_YIELD_ATTEMPTS) {
 			poll(NULL, 0, CDS_WFS_WAIT);	/* Wait for 10ms */
 			attempt = 0;
-		} else
+		} else if (attempt >= CDS_WFS_ADAPT_ATTEMPTS)
+			sched_yield();
+		else
 			caa_cpu_relax();
 	}
 	if (uatomic_cmpxchg(&s->head, head, next) == head)